@@ -0,0 +1,83 @@
+/**
+ * @file benchmark.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-03-28 10:52:16
+ * @brief Reloadable/EpochReloadable读取吞吐随线程数的变化
+ *
+ **/
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "epoch_reloadable.h"
+#include "reloadable.h"
+#include "timer.h"
+
+using namespace common;
+
+static const size_t kMaxThreadNum = 64;
+static const int64_t kRunMs = 200;
+
+struct Resource {
+    size_t value = 1;
+};
+
+template<typename ReloadableType>
+static void read_func(ReloadableType* reloadable, std::atomic<bool>* running, size_t* count) {
+    size_t local_count = 0;
+    size_t sum = 0;
+    while (running->load(std::memory_order_relaxed)) {
+        auto handle = reloadable->get_resource();
+        auto copy = handle;
+        sum += copy->value;
+        ++local_count;
+    }
+    *count = local_count + (sum == 0 ? 1 : 0);
+}
+
+// reads per second of thread_num readers, with a reload per 10ms
+template<typename ReloadableType>
+static double bench(ReloadableType* reloadable, size_t thread_num) {
+    std::atomic<bool> running(true);
+    std::vector<size_t> counts(thread_num, 0);
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < thread_num; ++i) {
+        readers.emplace_back(&read_func<ReloadableType>, reloadable, &running, &counts[i]);
+    }
+
+    MillisecondsTimer timer;
+    while (timer.tick() < kRunMs) {
+        std::this_thread::sleep_for(Milliseconds(10));
+        reloadable->reload(nullptr);
+    }
+    running = false;
+    for (auto& t : readers) {
+        t.join();
+    }
+
+    size_t total = 0;
+    for (size_t count : counts) {
+        total += count;
+    }
+    return total * 1000.0 / timer.tick();
+}
+
+int main(int argc, char** argv) {
+    Reloadable<Resource> reloadable;
+    reloadable.init(nullptr);
+    EpochReloadable<Resource> epoch_reloadable;
+    epoch_reloadable.init(nullptr);
+
+    std::cout << "threads\treloadable(reads/s)\tepoch_reloadable(reads/s)" << std::endl;
+    for (size_t thread_num = 1; thread_num <= kMaxThreadNum; thread_num <<= 1) {
+        double qps = bench(&reloadable, thread_num);
+        double epoch_qps = bench(&epoch_reloadable, thread_num);
+        std::cout << thread_num << "\t" << static_cast<size_t>(qps)
+                  << "\t" << static_cast<size_t>(epoch_qps) << std::endl;
+    }
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
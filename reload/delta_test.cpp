@@ -0,0 +1,97 @@
+/**
+ * @file delta_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-02 16:05:47
+ * @brief reload_delta测试, 新版本只复制被修改的分片
+ *
+ **/
+
+#include <assert.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "epoch_reloadable.h"
+#include "reloadable.h"
+#include "sharded_map.h"
+
+using namespace common;
+
+typedef ShardedMap<int, std::string> Dict;
+// key -> new value, empty value means erase
+typedef std::vector<std::pair<int, std::string> > ChangeSet;
+
+static const int kKeyNum = 10000;
+
+static Dict* load_full(void* /*params*/) {
+    Dict::Builder builder;
+    for (int i = 0; i < kKeyNum; ++i) {
+        builder.set(i, std::to_string(i));
+    }
+    return builder.build();
+}
+
+static Dict* load_delta(const Dict* current, void* params) {
+    const ChangeSet* changes = static_cast<const ChangeSet*>(params);
+    Dict::Builder builder(*current);
+    for (const auto& change : *changes) {
+        if (change.second.empty()) {
+            builder.erase(change.first);
+        } else {
+            builder.set(change.first, change.second);
+        }
+    }
+    return builder.build();
+}
+
+static size_t shared_shards(const Dict& a, const Dict& b) {
+    size_t shared = 0;
+    for (size_t i = 0; i < a.shard_count(); ++i) {
+        shared += a.shares_shard(b, i) ? 1 : 0;
+    }
+    return shared;
+}
+
+template<typename ReloadableType>
+static void test_delta(ReloadableType* reloadable) {
+    ChangeSet changes = {{1, "one"}, {2, ""}};
+    // no delta loader
+    int ret = reloadable->reload_delta(&changes);
+    assert(ret == RET_LOAD_FAIL);
+
+    reloadable->set_resource_loader(&load_full);
+    reloadable->set_delta_loader(&load_delta);
+    ret = reloadable->init(nullptr);
+    assert(ret == RET_SUCC);
+    auto old_handle = reloadable->get_resource();
+
+    ret = reloadable->reload_delta(&changes);
+    assert(ret == RET_SUCC);
+    (void)ret;
+    auto new_handle = reloadable->get_resource();
+    assert(*new_handle->find(1) == "one");
+    assert(new_handle->find(2) == nullptr);
+    assert(*new_handle->find(3) == "3");
+    assert(new_handle->size() == kKeyNum - 1);
+    // old version unchanged
+    assert(*old_handle->find(1) == "1");
+    assert(old_handle->size() == kKeyNum);
+
+    size_t shared = shared_shards(*old_handle, *new_handle);
+    std::cout << "shared shards: " << shared << "/" << new_handle->shard_count() << std::endl;
+    assert(shared + 2 >= new_handle->shard_count());
+}
+
+int main(int argc, char** argv) {
+    {
+        Reloadable<Dict> reloadable;
+        test_delta(&reloadable);
+    }
+    {
+        EpochReloadable<Dict> reloadable;
+        test_delta(&reloadable);
+    }
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,294 @@
+/**
+ * @file epoch_reloadable.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-03-26 16:08:41
+ * @brief 基于epoch的多版本reload实现
+ *        reload从不因旧版本被占用而失败, 旧版本在最后一个读者释放时回收
+ *        读取资源wait-free, 只有reload加锁
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "reloadable.h"
+
+namespace common {
+
+// one loaded version, ref counted by handles and by being current
+template<typename Resource, typename Deleter>
+struct EpochVersion {
+    typedef uint32_t ref_count_t;
+
+    explicit EpochVersion(Resource* res) : resource(res), refs(1), retired_counter(nullptr) {}
+
+    void ref() {
+        refs.fetch_add(1);
+    }
+
+    // the last one releases resource
+    void unref() {
+        if (refs.fetch_sub(1) == 1) {
+            if (retired_counter != nullptr) {
+                retired_counter->fetch_sub(1);
+            }
+            delete this;
+        }
+    }
+
+    std::unique_ptr<Resource, Deleter> resource;
+    std::atomic<ref_count_t> refs;
+    // set when replaced by a newer version
+    std::atomic<size_t>* retired_counter;
+};
+
+template<typename Resource, typename Deleter>
+class EpochResourceHandle;
+
+// thread-safely
+// handles must not outlive the EpochReloadable
+template<typename Resource, typename Deleter = std::default_delete<Resource> >
+class EpochReloadable {
+private:
+    typedef EpochVersion<Resource, Deleter> Version;
+
+    // reader counters of odd and even epoch, on different cache lines
+    struct alignas(64) ReaderCounter {
+        std::atomic<size_t> count;
+    };
+
+public:
+    typedef Resource ResourceType;
+    typedef std::function<Resource* (void*)> ResourceLoader;
+    // build a new version from the current one and a change set, see Reloadable
+    typedef std::function<Resource* (const Resource*, void*)> DeltaLoader;
+    // run on a loaded resource before it is published, see Reloadable
+    typedef std::function<bool (Resource*)> WarmupFunc;
+    // pointer type for outside, with ref count
+    typedef EpochResourceHandle<Resource, Deleter> ResourcePointer;
+
+    EpochReloadable()
+        : _loader(DefaultResourceLoader<Resource>()),
+          _max_retired_versions(0),
+          _epoch(0),
+          _current(nullptr),
+          _retired_versions(0) {
+        _readers[0].count.store(0);
+        _readers[1].count.store(0);
+    }
+
+    ~EpochReloadable() {
+        Version* version = _current.exchange(nullptr);
+        if (version != nullptr) {
+            synchronize();
+            version->unref();
+        }
+    }
+
+    void set_resource_loader(const ResourceLoader& loader) {
+        _loader = loader;
+    }
+
+    void set_delta_loader(const DeltaLoader& delta_loader) {
+        _delta_loader = delta_loader;
+    }
+
+    // 预热, 在新版本对读者可见前执行
+    void set_warmup(const WarmupFunc& warmup) {
+        _warmup = warmup;
+    }
+
+    // 旧版本个数上限, 达到上限时reload返回RET_BUFFER_INUSE, 0为不限制
+    void set_max_retired_versions(size_t max_retired_versions) {
+        _max_retired_versions.store(max_retired_versions);
+    }
+
+    int init(void *params) {
+        return load_resource(params);
+    }
+
+    int reload(void *params) {
+        return load_resource(params);
+    }
+
+    // 增量reload, delta loader基于当前版本和change_set构造新版本
+    int reload_delta(void *change_set) {
+        return load_resource(change_set, true);
+    }
+
+    // replaced versions still held by readers
+    size_t retired_versions() const {
+        return _retired_versions.load();
+    }
+
+    // wait-free: pin the epoch, ref current version, then unpin
+    ResourcePointer get_resource() {
+        ReaderCounter& readers = _readers[_epoch.load() & 0x01];
+        readers.count.fetch_add(1);
+        Version* version = _current.load();
+        if (version != nullptr) {
+            version->ref();
+        }
+        readers.count.fetch_sub(1);
+        return ResourcePointer(version);
+    }
+
+private:
+    int load_resource(void *params, bool is_delta = false) {
+        std::lock_guard<std::mutex> lock(_reload_mutex);
+        size_t max_retired_versions = _max_retired_versions.load();
+        if (max_retired_versions > 0 && _retired_versions.load() >= max_retired_versions) {
+            return RET_BUFFER_INUSE;
+        }
+
+        Resource *resource = nullptr;
+        if (is_delta) {
+            // current version is only replaced under reload lock
+            Version* current = _current.load();
+            resource = (_delta_loader && current != nullptr) ?
+                    _delta_loader(current->resource.get(), params) : nullptr;
+        } else {
+            resource = _loader(params);
+        }
+        if (nullptr == resource) {
+            return RET_LOAD_FAIL;
+        }
+        if (_warmup && !_warmup(resource)) {
+            std::unique_ptr<Resource, Deleter> drop(resource);
+            return RET_LOAD_FAIL;
+        }
+
+        Version* old_version = _current.exchange(new Version(resource));
+        if (old_version != nullptr) {
+            ++_retired_versions;
+            old_version->retired_counter = &_retired_versions;
+            // readers may have loaded old version but not ref it yet
+            synchronize();
+            old_version->unref();
+        }
+        return RET_SUCC;
+    }
+
+    // wait until readers pinned before now leave, should be under lock
+    // readers pinned later can only see the new version
+    void synchronize() {
+        for (int phase = 0; phase < 2; ++phase) {
+            size_t index = _epoch.fetch_add(1) & 0x01;
+            while (_readers[index].count.load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    std::mutex _reload_mutex;
+    ResourceLoader _loader;
+    DeltaLoader _delta_loader;
+    WarmupFunc _warmup;
+    std::atomic<size_t> _max_retired_versions;
+    std::atomic<size_t> _epoch;
+    ReaderCounter _readers[2];
+    std::atomic<Version*> _current;
+    std::atomic<size_t> _retired_versions;
+};
+
+// thread-unsafe
+// should not access one EpochResourceHandle in different threads
+template<typename Resource, typename Deleter = std::default_delete<Resource> >
+class EpochResourceHandle {
+private:
+    friend class EpochReloadable<Resource, Deleter>;
+    typedef EpochVersion<Resource, Deleter> Version;
+
+    // acccess by EpochReloadable only, adopt a ref of version
+    explicit EpochResourceHandle(Version* version) : _version(version) {}
+
+public:
+    typedef Resource ResourceType;
+
+    EpochResourceHandle() : _version(nullptr) {}
+
+    EpochResourceHandle(const EpochResourceHandle& other) : _version(other._version) {
+        if (_version != nullptr) {
+            _version->ref();
+        }
+    }
+
+    EpochResourceHandle(EpochResourceHandle&& other) : _version(other._version) {
+        other._version = nullptr;
+    }
+
+    ~EpochResourceHandle() {
+        release();
+    }
+
+    EpochResourceHandle& operator =(const EpochResourceHandle& other) {
+        if (this != &other) {
+            release();
+            _version = other._version;
+            if (_version != nullptr) {
+                _version->ref();
+            }
+        }
+        return *this;
+    }
+
+    EpochResourceHandle& operator =(EpochResourceHandle&& other) {
+        if (this != &other) {
+            release();
+            _version = other._version;
+            other._version = nullptr;
+        }
+        return *this;
+    }
+
+    void release() {
+        if (_version != nullptr) {
+            _version->unref();
+            _version = nullptr;
+        }
+    }
+
+    Resource* get() {
+        return _version == nullptr ? nullptr : _version->resource.get();
+    }
+
+    const Resource* get() const {
+        return _version == nullptr ? nullptr : _version->resource.get();
+    }
+
+    Resource* operator ->() {
+        return get();
+    }
+
+    const Resource* operator ->() const {
+        return get();
+    }
+
+    Resource& operator *() {
+        return *get();
+    }
+
+    const Resource& operator *() const {
+        return *get();
+    }
+
+    bool is_null() const {
+        return get() == nullptr;
+    }
+
+    explicit operator bool() const noexcept {
+        return !is_null();
+    }
+
+private:
+    Version* _version;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
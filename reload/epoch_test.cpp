@@ -0,0 +1,104 @@
+/**
+ * @file epoch_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-03-26 17:30:12
+ * @brief EpochReloadable测试, 慢读者持有旧版本时reload仍然成功
+ *
+ **/
+
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "epoch_reloadable.h"
+#include "timer.h"
+
+using namespace common;
+
+static const size_t kReaderNum = 8;
+static const size_t kReloadCount = 100;
+
+static std::atomic<size_t> g_resource_count(0);
+static std::atomic<size_t> g_alive_count(0);
+static std::atomic<bool> g_reload_switch(true);
+
+class Resource {
+public:
+    Resource() : _id(++g_resource_count) {
+        ++g_alive_count;
+    }
+
+    ~Resource() {
+        --g_alive_count;
+    }
+
+    size_t id() const { return _id; }
+
+private:
+    size_t _id;
+};
+
+static void reader_func(EpochReloadable<Resource>* reloadable, size_t index) {
+    size_t fetch_count = 0;
+    while (g_reload_switch) {
+        EpochReloadable<Resource>::ResourcePointer handle = reloadable->get_resource();
+        assert(handle);
+        size_t id = handle->id();
+        // slow reader holds the version across several reloads
+        if (index == 0) {
+            std::this_thread::sleep_for(Milliseconds(25));
+        }
+        EpochReloadable<Resource>::ResourcePointer copy = handle;
+        assert(copy->id() == id);
+        (void)id;
+        ++fetch_count;
+    }
+    std::cout << "Reader " << index << " fetch count: " << fetch_count << std::endl;
+}
+
+int main(int argc, char** argv) {
+    {
+        EpochReloadable<Resource> reloadable;
+        int ret = reloadable.init(nullptr);
+        assert(ret == RET_SUCC);
+
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < kReaderNum; ++i) {
+            readers.emplace_back(std::bind(&reader_func, &reloadable, i));
+        }
+
+        for (size_t i = 0; i < kReloadCount; ++i) {
+            std::this_thread::sleep_for(Milliseconds(2));
+            ret = reloadable.reload(nullptr);
+            assert(ret == RET_SUCC);
+        }
+        std::cout << "Reload count: " << kReloadCount
+                  << ", retired versions: " << reloadable.retired_versions() << std::endl;
+
+        g_reload_switch = false;
+        for (auto& t : readers) {
+            t.join();
+        }
+        assert(reloadable.retired_versions() == 0);
+        assert(g_alive_count == 1);
+
+        // bounded retired versions
+        reloadable.set_max_retired_versions(1);
+        auto holder = reloadable.get_resource();
+        ret = reloadable.reload(nullptr);
+        assert(ret == RET_SUCC);
+        ret = reloadable.reload(nullptr);
+        assert(ret == RET_BUFFER_INUSE);
+        holder.release();
+        ret = reloadable.reload(nullptr);
+        assert(ret == RET_SUCC);
+        (void)ret;
+    }
+    assert(g_alive_count == 0);
+    std::cout << "Resource created: " << g_resource_count << ", alive: " << g_alive_count << std::endl;
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,401 @@
+/**
+ * @file flat_image.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-04 10:36:52
+ * @brief 扁平二进制资源镜像, mmap只读加载, 零拷贝读取
+ *        镜像包含按key排序的kv表, 可选的hash索引和字符串池, 由FlatTableBuilder离线生成
+ **/
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "reloadable.h"
+
+namespace common {
+
+static const uint32_t FLAT_IMAGE_MAGIC = 0x474D4946;  // "FIMG"
+static const uint32_t FLAT_IMAGE_VERSION = 1;
+static const uint32_t FLAT_EMPTY_BUCKET = 0xFFFFFFFF;
+
+struct FlatImageOptions {
+    FlatImageOptions() : populate(false), advice(MADV_NORMAL) {}
+
+    // MAP_POPULATE, fault in all pages while loading instead of on first access
+    bool populate;
+    // madvise on the whole image, e.g. MADV_WILLNEED or MADV_RANDOM
+    int advice;
+};
+
+// layout: header | entries | buckets | string pool, all offsets from image start
+struct FlatImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t image_size;
+    uint64_t entry_count;
+    uint64_t entry_offset;
+    // power of 2, 0 for no hash index
+    uint64_t bucket_count;
+    uint64_t bucket_offset;
+    uint64_t pool_size;
+    uint64_t pool_offset;
+};
+
+// entries are sorted by key, key and value are offsets in string pool
+struct FlatEntry {
+    uint64_t key_offset;
+    uint64_t value_offset;
+    uint32_t key_len;
+    uint32_t value_len;
+};
+
+// zero copy view of a string in image
+struct FlatSlice {
+    FlatSlice() : data(nullptr), size(0) {}
+    FlatSlice(const char* d, size_t s) : data(d), size(s) {}
+    FlatSlice(const std::string& str) : data(str.data()), size(str.size()) {}
+
+    int compare(const FlatSlice& other) const {
+        int ret = memcmp(data, other.data, std::min(size, other.size));
+        if (ret != 0) {
+            return ret;
+        }
+        return size < other.size ? -1 : (size > other.size ? 1 : 0);
+    }
+
+    bool operator ==(const FlatSlice& other) const {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+
+    std::string to_string() const {
+        return std::string(data, size);
+    }
+
+    const char* data;
+    size_t size;
+};
+
+// fnv-1a, fixed so images are portable between builds
+inline uint64_t flat_hash(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// read-only kv table mapped from an image file
+// pages are shared by all processes mapping the same file
+class FlatTable {
+public:
+    FlatTable() : _base(nullptr), _size(0), _header(nullptr),
+                  _entries(nullptr), _buckets(nullptr), _pool(nullptr) {}
+
+    ~FlatTable() {
+        close();
+    }
+
+    FlatTable(const FlatTable&) = delete;
+    FlatTable& operator =(const FlatTable&) = delete;
+
+    int open(const std::string& path, const FlatImageOptions& options = FlatImageOptions()) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return RET_LOAD_FAIL;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FlatImageHeader)) {
+            ::close(fd);
+            return RET_LOAD_FAIL;
+        }
+        int flags = MAP_PRIVATE | (options.populate ? MAP_POPULATE : 0);
+        void* base = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+        // mapping stays valid after close, and after the file is replaced by rename
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            return RET_LOAD_FAIL;
+        }
+        _base = static_cast<const char*>(base);
+        _size = st.st_size;
+        if (options.advice != MADV_NORMAL) {
+            madvise(base, _size, options.advice);
+        }
+        if (!attach()) {
+            close();
+            return RET_LOAD_FAIL;
+        }
+        return RET_SUCC;
+    }
+
+    void close() {
+        if (_base != nullptr) {
+            munmap(const_cast<char*>(_base), _size);
+        }
+        _base = nullptr;
+        _size = 0;
+        _header = nullptr;
+        _entries = nullptr;
+        _buckets = nullptr;
+        _pool = nullptr;
+    }
+
+    size_t size() const {
+        return _header == nullptr ? 0 : _header->entry_count;
+    }
+
+    FlatSlice key(size_t index) const {
+        const FlatEntry& entry = _entries[index];
+        return FlatSlice(_pool + entry.key_offset, entry.key_len);
+    }
+
+    FlatSlice value(size_t index) const {
+        const FlatEntry& entry = _entries[index];
+        return FlatSlice(_pool + entry.value_offset, entry.value_len);
+    }
+
+    // index of the first key not less than key, size() if none
+    size_t lower_bound(const FlatSlice& key) const {
+        size_t low = 0;
+        size_t high = size();
+        while (low < high) {
+            size_t mid = low + ((high - low) >> 1);
+            if (this->key(mid).compare(key) < 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    // by hash index if built with one, otherwise binary search
+    bool find(const FlatSlice& key, FlatSlice* value) const {
+        size_t index = _buckets != nullptr ? hash_find(key) : lower_bound(key);
+        if (index >= size() || !(this->key(index) == key)) {
+            return false;
+        }
+        if (value != nullptr) {
+            *value = this->value(index);
+        }
+        return true;
+    }
+
+    const FlatImageHeader* header() const {
+        return _header;
+    }
+
+private:
+    // check sections, entries and buckets all lie in the image, so that a truncated or
+    // corrupt image is rejected instead of read out of bounds later
+    bool attach() {
+        const FlatImageHeader* header = reinterpret_cast<const FlatImageHeader*>(_base);
+        if (header->magic != FLAT_IMAGE_MAGIC || header->version != FLAT_IMAGE_VERSION
+                || header->image_size != _size) {
+            return false;
+        }
+        if (!in_image(header->entry_offset, header->entry_count, sizeof(FlatEntry))
+                || !in_image(header->bucket_offset, header->bucket_count, sizeof(uint32_t))
+                || !in_image(header->pool_offset, header->pool_size, 1)
+                || (header->bucket_count & (header->bucket_count - 1)) != 0
+                || header->entry_offset % alignof(FlatEntry) != 0
+                || header->bucket_offset % alignof(uint32_t) != 0) {
+            return false;
+        }
+        const FlatEntry* entries = reinterpret_cast<const FlatEntry*>(_base + header->entry_offset);
+        for (uint64_t i = 0; i < header->entry_count; ++i) {
+            if (!in_range(entries[i].key_offset, entries[i].key_len, header->pool_size)
+                    || !in_range(entries[i].value_offset, entries[i].value_len, header->pool_size)) {
+                return false;
+            }
+        }
+        const uint32_t* buckets = header->bucket_count == 0 ? nullptr :
+                reinterpret_cast<const uint32_t*>(_base + header->bucket_offset);
+        if (buckets != nullptr) {
+            // probing stops only at an empty bucket
+            bool has_empty = false;
+            for (uint64_t i = 0; i < header->bucket_count; ++i) {
+                if (buckets[i] == FLAT_EMPTY_BUCKET) {
+                    has_empty = true;
+                } else if (buckets[i] >= header->entry_count) {
+                    return false;
+                }
+            }
+            if (!has_empty) {
+                return false;
+            }
+        }
+        _header = header;
+        _entries = entries;
+        _buckets = buckets;
+        _pool = _base + header->pool_offset;
+        return true;
+    }
+
+    bool in_image(uint64_t offset, uint64_t count, uint64_t item_size) const {
+        return offset <= _size && count <= (_size - offset) / item_size;
+    }
+
+    static bool in_range(uint64_t offset, uint64_t len, uint64_t size) {
+        return offset <= size && len <= size - offset;
+    }
+
+    // linear probing, the builder keeps load factor under 0.5
+    size_t hash_find(const FlatSlice& key) const {
+        uint64_t mask = _header->bucket_count - 1;
+        for (uint64_t bucket = flat_hash(key.data, key.size) & mask; ; bucket = (bucket + 1) & mask) {
+            uint32_t index = _buckets[bucket];
+            if (index == FLAT_EMPTY_BUCKET || this->key(index) == key) {
+                return index == FLAT_EMPTY_BUCKET ? size() : index;
+            }
+        }
+    }
+
+private:
+    const char* _base;
+    size_t _size;
+    const FlatImageHeader* _header;
+    const FlatEntry* _entries;
+    const uint32_t* _buckets;
+    const char* _pool;
+};
+
+// ResourceLoader of Reloadable<FlatTable>, params is the image path as const char*
+struct FlatTableLoader {
+    FlatTableLoader() {}
+    explicit FlatTableLoader(const FlatImageOptions& opts) : options(opts) {}
+
+    FlatTable* operator ()(void* params) const {
+        if (params == nullptr) {
+            return nullptr;
+        }
+        FlatTable* table = new (std::nothrow) FlatTable();
+        if (table != nullptr && table->open(static_cast<const char*>(params), options) != RET_SUCC) {
+            delete table;
+            table = nullptr;
+        }
+        return table;
+    }
+
+    FlatImageOptions options;
+};
+
+// offline builder of flat images
+// duplicated keys keep the last value, equal strings are stored once in string pool
+class FlatTableBuilder {
+public:
+    void add(const std::string& key, const std::string& value) {
+        _items.emplace_back(key, value);
+    }
+
+    size_t size() const {
+        return _items.size();
+    }
+
+    // write to path.tmp then rename, a running process mapping the old image is not affected
+    int write(const std::string& path, bool with_hash_index = true) {
+        std::stable_sort(_items.begin(), _items.end(),
+                [](const Item& a, const Item& b) { return a.first < b.first; });
+        std::vector<Item> items;
+        for (auto& item : _items) {
+            if (!items.empty() && items.back().first == item.first) {
+                items.back().second.swap(item.second);
+            } else {
+                items.emplace_back(std::move(item));
+            }
+        }
+        _items.clear();
+        if (items.size() >= FLAT_EMPTY_BUCKET) {
+            return RET_LOAD_FAIL;
+        }
+
+        std::string pool;
+        std::unordered_map<std::string, uint64_t> pooled;
+        std::vector<FlatEntry> entries(items.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            entries[i].key_offset = pool_string(items[i].first, &pool, &pooled);
+            entries[i].key_len = items[i].first.size();
+            entries[i].value_offset = pool_string(items[i].second, &pool, &pooled);
+            entries[i].value_len = items[i].second.size();
+        }
+
+        std::vector<uint32_t> buckets;
+        if (with_hash_index && !items.empty()) {
+            size_t bucket_count = 1;
+            while (bucket_count < items.size() * 2) {
+                bucket_count <<= 1;
+            }
+            buckets.assign(bucket_count, FLAT_EMPTY_BUCKET);
+            for (size_t i = 0; i < items.size(); ++i) {
+                const std::string& key = items[i].first;
+                size_t bucket = flat_hash(key.data(), key.size()) & (bucket_count - 1);
+                while (buckets[bucket] != FLAT_EMPTY_BUCKET) {
+                    bucket = (bucket + 1) & (bucket_count - 1);
+                }
+                buckets[bucket] = i;
+            }
+        }
+
+        FlatImageHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = FLAT_IMAGE_MAGIC;
+        header.version = FLAT_IMAGE_VERSION;
+        header.entry_count = entries.size();
+        header.entry_offset = sizeof(header);
+        header.bucket_count = buckets.size();
+        header.bucket_offset = header.entry_offset + entries.size() * sizeof(FlatEntry);
+        header.pool_size = pool.size();
+        header.pool_offset = header.bucket_offset + buckets.size() * sizeof(uint32_t);
+        header.image_size = header.pool_offset + pool.size();
+
+        std::string tmp_path = path + ".tmp";
+        FILE* fp = fopen(tmp_path.c_str(), "wb");
+        if (fp == nullptr) {
+            return RET_LOAD_FAIL;
+        }
+        auto write_section = [fp](const void* data, size_t item_size, size_t count) {
+            return count == 0 || fwrite(data, item_size, count, fp) == count;
+        };
+        bool ok = write_section(&header, sizeof(header), 1)
+                && write_section(entries.data(), sizeof(FlatEntry), entries.size())
+                && write_section(buckets.data(), sizeof(uint32_t), buckets.size())
+                && write_section(pool.data(), 1, pool.size());
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            unlink(tmp_path.c_str());
+            return RET_LOAD_FAIL;
+        }
+        return RET_SUCC;
+    }
+
+private:
+    typedef std::pair<std::string, std::string> Item;
+
+    static uint64_t pool_string(const std::string& str, std::string* pool,
+            std::unordered_map<std::string, uint64_t>* pooled) {
+        auto ret = pooled->emplace(str, pool->size());
+        if (ret.second) {
+            pool->append(str);
+        }
+        return ret.first->second;
+    }
+
+    std::vector<Item> _items;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,52 @@
+/**
+ * @file flat_image_builder.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-04 15:12:09
+ * @brief 离线生成扁平资源镜像
+ *        usage: flat_image_builder <input> <output> [--no-hash]
+ *        input每行一条记录, key和value以tab分隔
+ **/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "flat_image.h"
+
+using namespace common;
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <input> <output> [--no-hash]" << std::endl;
+        return 1;
+    }
+    bool with_hash_index = !(argc > 3 && std::string(argv[3]) == "--no-hash");
+
+    std::ifstream input(argv[1]);
+    if (!input) {
+        std::cerr << "open " << argv[1] << " failed" << std::endl;
+        return 1;
+    }
+    FlatTableBuilder builder;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(input, line)) {
+        ++line_no;
+        size_t pos = line.find('\t');
+        if (pos == std::string::npos) {
+            std::cerr << "skip line " << line_no << ": no tab" << std::endl;
+            continue;
+        }
+        builder.add(line.substr(0, pos), line.substr(pos + 1));
+    }
+
+    size_t count = builder.size();
+    if (builder.write(argv[2], with_hash_index) != RET_SUCC) {
+        std::cerr << "write " << argv[2] << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "write " << count << " records to " << argv[2] << std::endl;
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,190 @@
+/**
+ * @file flat_image_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-04 16:40:21
+ * @brief FlatTable测试, 离线生成镜像后通过Reloadable加载和reload
+ *
+ **/
+
+#include <assert.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "flat_image.h"
+#include "reloadable.h"
+#include "timer.h"
+
+using namespace common;
+
+static const size_t kRecordNum = 100000;
+static const char* kImagePath = "./flat_image_test.img";
+static const char* kCorruptPath = "./flat_image_test.corrupt";
+
+static void build_image(const std::string& suffix, bool with_hash_index) {
+    FlatTableBuilder builder;
+    for (size_t i = 0; i < kRecordNum; ++i) {
+        // values repeat, stored once in string pool
+        builder.add("key_" + std::to_string(i), "value_" + std::to_string(i % 100) + suffix);
+    }
+    builder.add("key_0", "last" + suffix);
+    int ret = builder.write(kImagePath, with_hash_index);
+    assert(ret == RET_SUCC);
+    (void)ret;
+}
+
+static void check_table(const FlatTable& table, const std::string& suffix) {
+    assert(table.size() == kRecordNum);
+    FlatSlice value;
+    bool found = table.find(std::string("key_0"), &value);
+    assert(found);
+    assert(value.to_string() == "last" + suffix);
+    found = table.find(std::string("key_12345"), &value);
+    assert(found);
+    assert(value.to_string() == "value_45" + suffix);
+    (void)found;
+    (void)suffix;
+    assert(!table.find(std::string("key_"), &value));
+    assert(!table.find(std::string("no_such_key"), nullptr));
+    for (size_t i = 1; i < table.size(); ++i) {
+        assert(table.key(i - 1).compare(table.key(i)) < 0);
+    }
+}
+
+static std::string read_file(const char* path) {
+    std::ifstream input(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+// write a modified copy of image, it must be rejected by open
+static void check_corrupt(const std::string& image,
+        const std::function<void (std::string*, FlatImageHeader*)>& corrupt) {
+    std::string data = image;
+    FlatImageHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    corrupt(&data, &header);
+    memcpy(&data[0], &header, sizeof(header));
+    std::ofstream output(kCorruptPath, std::ios::binary | std::ios::trunc);
+    output.write(data.data(), data.size());
+    output.close();
+
+    FlatTable table;
+    int ret = table.open(kCorruptPath);
+    assert(ret == RET_LOAD_FAIL);
+    assert(table.size() == 0);
+    (void)ret;
+}
+
+static FlatEntry* entry_at(std::string* data, const FlatImageHeader& header, size_t index) {
+    return reinterpret_cast<FlatEntry*>(&(*data)[header.entry_offset]) + index;
+}
+
+static uint32_t* bucket_at(std::string* data, const FlatImageHeader& header, size_t index) {
+    return reinterpret_cast<uint32_t*>(&(*data)[header.bucket_offset]) + index;
+}
+
+static void test_corrupt_image() {
+    FlatTableBuilder builder;
+    for (size_t i = 0; i < 16; ++i) {
+        builder.add("key_" + std::to_string(i), "value_" + std::to_string(i));
+    }
+    int ret = builder.write(kCorruptPath, true);
+    assert(ret == RET_SUCC);
+    const std::string image = read_file(kCorruptPath);
+    {
+        FlatTable table;
+        ret = table.open(kCorruptPath);
+        assert(ret == RET_SUCC);
+        (void)ret;
+    }
+
+    // truncated, with or without the size in header fixed up
+    check_corrupt(image, [](std::string* data, FlatImageHeader*) {
+        data->resize(data->size() - 1);
+    });
+    check_corrupt(image, [](std::string* data, FlatImageHeader* header) {
+        data->resize(data->size() - 1);
+        header->image_size = data->size();
+        header->pool_size -= 1;
+    });
+    check_corrupt(image, [](std::string*, FlatImageHeader* header) {
+        header->entry_count += 1;
+    });
+    check_corrupt(image, [](std::string*, FlatImageHeader* header) {
+        header->entry_offset += 1;
+    });
+    // entries point out of string pool
+    check_corrupt(image, [](std::string* data, FlatImageHeader* header) {
+        entry_at(data, *header, 3)->key_offset = header->pool_size;
+    });
+    check_corrupt(image, [](std::string* data, FlatImageHeader* header) {
+        entry_at(data, *header, 5)->value_len = 0xFFFFFFFF;
+    });
+    check_corrupt(image, [](std::string* data, FlatImageHeader* header) {
+        entry_at(data, *header, 0)->value_offset = ~0ULL;
+    });
+    // buckets point out of entries, or no empty bucket to stop probing
+    check_corrupt(image, [](std::string* data, FlatImageHeader* header) {
+        for (size_t i = 0; i < header->bucket_count; ++i) {
+            uint32_t* bucket = bucket_at(data, *header, i);
+            if (*bucket != FLAT_EMPTY_BUCKET) {
+                *bucket = header->entry_count;
+                break;
+            }
+        }
+    });
+    check_corrupt(image, [](std::string* data, FlatImageHeader* header) {
+        for (size_t i = 0; i < header->bucket_count; ++i) {
+            *bucket_at(data, *header, i) = i % header->entry_count;
+        }
+    });
+    unlink(kCorruptPath);
+    std::cout << "corrupt images rejected" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    test_corrupt_image();
+
+    MillisecondsTimer timer;
+    build_image("", true);
+    std::cout << "build image cost " << timer.tick() << "ms" << std::endl;
+
+    FlatImageOptions options;
+    options.populate = true;
+    options.advice = MADV_WILLNEED;
+    Reloadable<FlatTable> reloadable;
+    reloadable.set_resource_loader(FlatTableLoader(options));
+    timer.reset();
+    int ret = reloadable.init(const_cast<char*>(kImagePath));
+    assert(ret == RET_SUCC);
+    std::cout << "load image cost " << timer.tick() << "ms" << std::endl;
+    {
+        auto handle = reloadable.get_resource();
+        check_table(*handle, "");
+        assert(handle->header()->bucket_count > 0);
+    }
+
+    // rebuild without hash index, the mapped old version is not affected
+    auto old_handle = reloadable.get_resource();
+    build_image("_v2", false);
+    check_table(*old_handle, "");
+    old_handle.release();
+    ret = reloadable.reload(const_cast<char*>(kImagePath));
+    assert(ret == RET_SUCC);
+    {
+        auto handle = reloadable.get_resource();
+        check_table(*handle, "_v2");
+        assert(handle->header()->bucket_count == 0);
+    }
+
+    ret = reloadable.reload(const_cast<char*>("./no_such_image"));
+    assert(ret == RET_LOAD_FAIL);
+    (void)ret;
+    unlink(kImagePath);
+    std::cout << "done" << std::endl;
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
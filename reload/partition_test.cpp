@@ -0,0 +1,98 @@
+/**
+ * @file partition_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-10 17:21:05
+ * @brief PartitionedLoader测试, 分区并行加载和单分区reload
+ *
+ **/
+
+#include <assert.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "partitioned_loader.h"
+#include "reloadable.h"
+#include "timer.h"
+
+using namespace common;
+
+static const size_t kPartitionNum = 8;
+static const uint32_t kThreadNum = 4;
+static const int64_t kLoadMs = 50;
+
+typedef std::vector<size_t> Partition;
+typedef PartitionedLoader<Partition> Loader;
+
+static std::atomic<size_t> g_load_count(0);
+
+// params: generation of the content, nullptr to fail
+static Partition* load_partition(size_t index, void* params) {
+    if (params == nullptr) {
+        return nullptr;
+    }
+    std::this_thread::sleep_for(Milliseconds(kLoadMs));
+    ++g_load_count;
+    return new Partition(1000, index * 1000 + *static_cast<size_t*>(params));
+}
+
+int main(int argc, char** argv) {
+    Loader loader(kPartitionNum, &load_partition, kThreadNum);
+    Reloadable<Loader::ResourceType> reloadable;
+    loader.attach(&reloadable);
+
+    size_t generation = 0;
+    MillisecondsTimer timer;
+    int ret = reloadable.init(&generation);
+    assert(ret == RET_SUCC);
+    int64_t cost = timer.tick();
+    std::cout << "load " << kPartitionNum << " partitions cost " << cost << "ms" << std::endl;
+    assert(cost < static_cast<int64_t>(kLoadMs * kPartitionNum));
+    assert(g_load_count == kPartitionNum);
+
+    auto old_handle = reloadable.get_resource();
+    old_handle.release();
+
+    // reload partition 3 only
+    generation = 1;
+    PartitionReloadRequest request;
+    request.partitions.push_back(3);
+    request.params = &generation;
+    ret = reloadable.reload_delta(&request);
+    assert(ret == RET_SUCC);
+    assert(g_load_count == kPartitionNum + 1);
+    {
+        auto handle = reloadable.get_resource();
+        assert(handle->partition_count() == kPartitionNum);
+        assert(handle->partition(3)[0] == 3001);
+        assert(handle->partition(4)[0] == 4000);
+    }
+
+    // shared partitions
+    {
+        Loader::ResourceType* current = loader.load(&generation);
+        request.partitions.assign(1, 5);
+        Loader::ResourceType* next = loader.reload(current, &request);
+        for (size_t i = 0; i < kPartitionNum; ++i) {
+            assert(next->shares_partition(*current, i) == (i != 5));
+        }
+        delete next;
+        delete current;
+    }
+
+    // failed partition keeps current version
+    request.params = nullptr;
+    ret = reloadable.reload_delta(&request);
+    assert(ret == RET_LOAD_FAIL);
+    request.partitions.assign(1, kPartitionNum);
+    request.params = &generation;
+    ret = reloadable.reload_delta(&request);
+    assert(ret == RET_LOAD_FAIL);
+    (void)ret;
+    assert(reloadable.get_resource()->partition(3)[0] == 3001);
+    std::cout << "done" << std::endl;
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,176 @@
+/**
+ * @file partitioned_loader.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-10 14:48:17
+ * @brief 分区资源的并行加载
+ *        资源由N个分区组成, 全量加载时各分区在线程池中并行加载
+ *        通过Reloadable::reload_delta可以只reload部分分区, 其余分区与旧版本共享
+ **/
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "reloadable.h"
+#include "thread_pool/fifo_task_queue.h"
+#include "thread_pool/thread_pool.h"
+
+namespace common {
+
+template<typename Partition>
+class PartitionedLoader;
+
+// immutable resource made of partitions, partitions may be shared between versions
+template<typename Partition>
+class PartitionedResource {
+public:
+    typedef std::shared_ptr<const Partition> PartitionPtr;
+
+    PartitionedResource() {}
+
+    size_t partition_count() const {
+        return _partitions.size();
+    }
+
+    const Partition& partition(size_t index) const {
+        return *_partitions[index];
+    }
+
+    // whether the index-th partition is shared with other
+    bool shares_partition(const PartitionedResource& other, size_t index) const {
+        return index < _partitions.size() && index < other._partitions.size()
+                && _partitions[index] == other._partitions[index];
+    }
+
+private:
+    friend class PartitionedLoader<Partition>;
+
+    explicit PartitionedResource(size_t partition_count) : _partitions(partition_count) {}
+
+    std::vector<PartitionPtr> _partitions;
+};
+
+// params of reload_delta, reload the given partitions only
+struct PartitionReloadRequest {
+    PartitionReloadRequest() : params(nullptr) {}
+
+    std::vector<size_t> partitions;
+    // passed to PartitionLoadFunc
+    void* params;
+};
+
+// loads partitions in parallel, the caller thread waits until all done
+// should not be called from a task of its own thread pool
+template<typename Partition>
+class PartitionedLoader {
+public:
+    typedef PartitionedResource<Partition> ResourceType;
+    // load the index-th partition, nullptr if failed
+    typedef std::function<Partition* (size_t index, void* params)> PartitionLoadFunc;
+
+    PartitionedLoader(size_t partition_count, const PartitionLoadFunc& load_func, uint32_t thread_num)
+        : _partition_count(partition_count),
+          _load_func(load_func),
+          _pool(thread_num == 0 ? 1 : thread_num) {
+        _pool.start(&_queue);
+    }
+
+    ~PartitionedLoader() {
+        _pool.stop(false);
+    }
+
+    size_t partition_count() const {
+        return _partition_count;
+    }
+
+    // ResourceLoader, load all partitions
+    ResourceType* load(void* params) {
+        std::vector<size_t> partitions(_partition_count);
+        for (size_t i = 0; i < _partition_count; ++i) {
+            partitions[i] = i;
+        }
+        return load_partitions(nullptr, partitions, params);
+    }
+
+    // DeltaLoader, params is a PartitionReloadRequest
+    ResourceType* reload(const ResourceType* current, void* params) {
+        const PartitionReloadRequest* request = static_cast<const PartitionReloadRequest*>(params);
+        if (current == nullptr || request == nullptr) {
+            return nullptr;
+        }
+        for (size_t index : request->partitions) {
+            if (index >= _partition_count) {
+                return nullptr;
+            }
+        }
+        return load_partitions(current, request->partitions, request->params);
+    }
+
+    // set both loaders of reloadable, must outlive it
+    template<typename ReloadableType>
+    void attach(ReloadableType* reloadable) {
+        using namespace std::placeholders;
+        reloadable->set_resource_loader(std::bind(&PartitionedLoader::load, this, _1));
+        reloadable->set_delta_loader(std::bind(&PartitionedLoader::reload, this, _1, _2));
+    }
+
+private:
+    PartitionedLoader(const PartitionedLoader&) = delete;
+    PartitionedLoader& operator =(const PartitionedLoader&) = delete;
+
+    // partitions not in the list are shared with current
+    ResourceType* load_partitions(const ResourceType* current,
+            const std::vector<size_t>& partitions, void* params) {
+        std::unique_ptr<ResourceType> resource(new (std::nothrow) ResourceType(_partition_count));
+        if (!resource) {
+            return nullptr;
+        }
+        if (current != nullptr) {
+            resource->_partitions = current->_partitions;
+            resource->_partitions.resize(_partition_count);
+        }
+
+        std::vector<Partition*> loaded(partitions.size(), nullptr);
+        std::mutex mutex;
+        std::condition_variable cond;
+        size_t remain = partitions.size();
+        for (size_t i = 0; i < partitions.size(); ++i) {
+            _queue.push_task([&, i]() {
+                Partition* partition = _load_func(partitions[i], params);
+                std::lock_guard<std::mutex> lock(mutex);
+                loaded[i] = partition;
+                if (--remain == 0) {
+                    cond.notify_one();
+                }
+            }, TaskAttr());
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&remain]() { return remain == 0; });
+        }
+
+        bool succ = true;
+        for (size_t i = 0; i < partitions.size(); ++i) {
+            succ = succ && loaded[i] != nullptr;
+            resource->_partitions[partitions[i]].reset(loaded[i]);
+        }
+        for (const auto& partition : resource->_partitions) {
+            succ = succ && partition != nullptr;
+        }
+        return succ ? resource.release() : nullptr;
+    }
+
+private:
+    const size_t _partition_count;
+    PartitionLoadFunc _load_func;
+    FifoTaskQueue _queue;
+    ThreadPool _pool;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,287 @@
+/**
+ * @file reload_scheduler.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-08 11:25:40
+ * @brief 基于inotify的后台reload调度
+ *        监听文件或目录的变化, 在debounce窗口内合并变化事件, 在后台线程池中执行reload
+ *        reload返回RET_BUFFER_INUSE时延迟重试
+ **/
+
+#pragma once
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "reloadable.h"
+#include "thread_pool/thread_pool.h"
+#include "thread_pool/timer_task_queue.h"
+
+namespace common {
+
+struct ReloadSchedulerOptions {
+    ReloadSchedulerOptions()
+        : debounce_ms(100), retry_interval_ms(50), max_retries(100), thread_num(1) {}
+
+    // events within this window after the first one are merged into one reload
+    int64_t debounce_ms;
+    // delay before retrying a reload returned RET_BUFFER_INUSE
+    int64_t retry_interval_ms;
+    uint32_t max_retries;
+    // reloads of different watches may run in parallel
+    uint32_t thread_num;
+};
+
+struct ReloadStats {
+    ReloadStats() : reload_count(0), fail_count(0), retry_count(0),
+                    last_latency_us(0), max_latency_us(0), last_reload_ms(0), last_event_ms(0) {}
+
+    uint64_t reload_count;
+    uint64_t fail_count;
+    uint64_t retry_count;
+    // from the first merged event to reload finished
+    int64_t last_latency_us;
+    int64_t max_latency_us;
+    // time of the last successful reload, 0 if never
+    int64_t last_reload_ms;
+    int64_t last_event_ms;
+};
+
+// thread-safely
+class ReloadScheduler {
+public:
+    typedef std::function<int()> ReloadFunc;
+
+    explicit ReloadScheduler(const ReloadSchedulerOptions& options = ReloadSchedulerOptions())
+        : _options(options),
+          _inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+          _stop_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          _pool(options.thread_num == 0 ? 1 : options.thread_num),
+          _running(false) {}
+
+    ~ReloadScheduler() {
+        stop();
+        if (_inotify_fd >= 0) {
+            ::close(_inotify_fd);
+        }
+        if (_stop_fd >= 0) {
+            ::close(_stop_fd);
+        }
+    }
+
+    // call reload_func after path changed, path can be a file or a directory
+    // a file is watched by its directory, so replacing it by rename is detected
+    // return watch id, -1 if failed
+    int watch(const std::string& path, const ReloadFunc& reload_func) {
+        if (_inotify_fd < 0 || path.empty() || !reload_func) {
+            return -1;
+        }
+        std::string dir = path;
+        std::string name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            size_t pos = path.rfind('/');
+            dir = pos == std::string::npos ? "." : (pos == 0 ? "/" : path.substr(0, pos));
+            name = pos == std::string::npos ? path : path.substr(pos + 1);
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        int wd = inotify_add_watch(_inotify_fd, dir.c_str(), WATCH_MASK);
+        if (wd < 0) {
+            return -1;
+        }
+        std::unique_ptr<Target> target(new Target());
+        target->id = _targets.size();
+        target->name = name;
+        target->reload_func = reload_func;
+        _wd_targets[wd].push_back(target.get());
+        _targets.push_back(std::move(target));
+        return _targets.back()->id;
+    }
+
+    // reload a Reloadable with params after path changed
+    template<typename ReloadableType>
+    int watch(const std::string& path, ReloadableType* reloadable, void* params) {
+        return watch(path, [reloadable, params]() { return reloadable->reload(params); });
+    }
+
+    bool start() {
+        if (_inotify_fd < 0 || _stop_fd < 0 || _running.exchange(true)) {
+            return false;
+        }
+        if (!_pool.start(&_queue)) {
+            _running.store(false);
+            return false;
+        }
+        _watcher = std::thread(&ReloadScheduler::watch_loop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!_running.exchange(false)) {
+            return;
+        }
+        uint64_t value = 1;
+        ssize_t ret = write(_stop_fd, &value, sizeof(value));
+        (void)ret;
+        _watcher.join();
+        // pending debounce and retry tasks are dropped
+        _pool.stop(false);
+    }
+
+    bool get_stats(int watch_id, ReloadStats* stats) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (watch_id < 0 || static_cast<size_t>(watch_id) >= _targets.size() || stats == nullptr) {
+            return false;
+        }
+        *stats = _targets[watch_id]->stats;
+        return true;
+    }
+
+    // ms since the last successful reload, -1 if never reloaded
+    int64_t version_age_ms(int watch_id) const {
+        ReloadStats stats;
+        if (!get_stats(watch_id, &stats) || stats.last_reload_ms == 0) {
+            return -1;
+        }
+        return get_milli() - stats.last_reload_ms;
+    }
+
+private:
+    ReloadScheduler(const ReloadScheduler&) = delete;
+    ReloadScheduler& operator =(const ReloadScheduler&) = delete;
+
+    static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM
+            | IN_CREATE | IN_DELETE;
+
+    struct Target {
+        Target() : id(-1), scheduled(false), first_event_us(0) {}
+
+        int id;
+        // file name in the watched directory, empty for the whole directory
+        std::string name;
+        ReloadFunc reload_func;
+        // a reload task is waiting in queue, guarded by scheduler mutex
+        bool scheduled;
+        int64_t first_event_us;
+        ReloadStats stats;
+        // serializes reloads of one target when thread_num > 1
+        std::mutex reload_mutex;
+    };
+
+    void watch_loop() {
+        // large enough for several events with names
+        alignas(struct inotify_event) char buffer[16 * 1024];
+        struct pollfd fds[2] = {{_inotify_fd, POLLIN, 0}, {_stop_fd, POLLIN, 0}};
+        while (true) {
+            int ret = poll(fds, 2, -1);
+            if (ret < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents != 0) {
+                break;
+            }
+            ssize_t len = 0;
+            while ((len = read(_inotify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + len; ) {
+                    const struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+                    on_event(event->wd, event->len > 0 ? event->name : "");
+                    p += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+    }
+
+    void on_event(int wd, const char* name) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _wd_targets.find(wd);
+        if (iter == _wd_targets.end()) {
+            return;
+        }
+        int64_t now = get_micro();
+        for (Target* target : iter->second) {
+            if (!target->name.empty() && target->name != name) {
+                continue;
+            }
+            target->stats.last_event_ms = now / 1000;
+            // the window starts from the first event, later ones ride on the scheduled reload
+            if (!target->scheduled) {
+                target->scheduled = true;
+                target->first_event_us = now;
+                schedule(target, _options.debounce_ms, 0);
+            }
+        }
+    }
+
+    // should be under lock
+    void schedule(Target* target, int64_t delay_ms, uint32_t retries) {
+        _queue.push_delay_task(delay_ms * 1000,
+                std::bind(&ReloadScheduler::run_reload, this, target, retries));
+    }
+
+    void run_reload(Target* target, uint32_t retries) {
+        std::lock_guard<std::mutex> reload_lock(target->reload_mutex);
+        int64_t first_event_us = 0;
+        {
+            // events from now on need another reload
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (retries == 0) {
+                target->scheduled = false;
+            }
+            first_event_us = target->first_event_us;
+        }
+
+        int ret = target->reload_func();
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        ReloadStats& stats = target->stats;
+        if (ret == RET_SUCC) {
+            int64_t now = get_micro();
+            ++stats.reload_count;
+            stats.last_reload_ms = now / 1000;
+            stats.last_latency_us = now - first_event_us;
+            stats.max_latency_us = std::max(stats.max_latency_us, stats.last_latency_us);
+        } else if (ret == RET_BUFFER_INUSE && retries < _options.max_retries) {
+            ++stats.retry_count;
+            // a newly scheduled reload will load the latest content anyway
+            if (!target->scheduled) {
+                schedule(target, _options.retry_interval_ms, retries + 1);
+            }
+        } else {
+            ++stats.fail_count;
+        }
+    }
+
+private:
+    const ReloadSchedulerOptions _options;
+    int _inotify_fd;
+    // wakes watcher up to stop
+    int _stop_fd;
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Target> > _targets;
+    std::unordered_map<int, std::vector<Target*> > _wd_targets;
+    TimerTaskQueue _queue;
+    ThreadPool _pool;
+    std::thread _watcher;
+    std::atomic<bool> _running;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
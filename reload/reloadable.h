@@ -13,6 +13,8 @@
 #include <memory>
 #include <mutex>
 
+#include "thread_pool/thread_index.h"
+
 namespace common {
 
 #define RET_SUCC 0
@@ -42,19 +44,45 @@ private:
     // pointer type for internal
     typedef std::unique_ptr<Resource, Deleter> resource_ptr_type;
 
+    // ref counts are striped by thread, readers in different threads never share a cache line
+    // a handle refs and unrefs on the same stripe, so the sum of stripes is the ref count
+    static const size_t REF_STRIPE_COUNT = 16;
+    struct alignas(64) RefStripe {
+        std::atomic<ref_count_t> count;
+    };
+
 public:
     typedef Resource ResourceType;
     typedef std::function<Resource* (void*)> ResourceLoader;
+    // build a new version from the current one and a change set,
+    // unchanged parts may be shared with current, e.g. ShardedMap
+    typedef std::function<Resource* (const Resource*, void*)> DeltaLoader;
+    // run on a loaded resource before it is published, false to drop it
+    typedef std::function<bool (Resource*)> WarmupFunc;
     // pointer type for outside, with ref count
     typedef ResourceHandle<Resource> ResourcePointer;
 
-    Reloadable() : _loader(DefaultResourceLoader<Resource>()) {}
+    Reloadable() : _loader(DefaultResourceLoader<Resource>()), _version(0) {
+        for (size_t i = 0; i < REF_STRIPE_COUNT; ++i) {
+            _refs[0][i].count.store(0);
+            _refs[1][i].count.store(0);
+        }
+    }
     ~Reloadable() {}
 
     void set_resource_loader(const ResourceLoader& loader) {
         _loader = loader;
     }
 
+    void set_delta_loader(const DeltaLoader& delta_loader) {
+        _delta_loader = delta_loader;
+    }
+
+    // Ԥ, °汾Զ߿ɼǰִ, ڴҳ, , طŶߵ, warmup.h
+    void set_warmup(const WarmupFunc& warmup) {
+        _warmup = warmup;
+    }
+
     int init(void *params) {
         return load_resource(params, false);
     }
@@ -63,10 +91,15 @@ public:
         return load_resource(params, true);
     }
 
+    // reload, delta loaderڵǰ汾change_set°汾
+    int reload_delta(void *change_set) {
+        return load_resource(change_set, true, true);
+    }
+
     int release_unused() {
         version_t version_to_release = _version.load() + 1;
         version_t index = version_to_release & 0x01;
-        if (_refs[index].load() == 0 && !_resource_container[index]) {
+        if (ref_count(index) == 0) {
             std::lock_guard<std::mutex> lock(_reload_mutex);
             // try release under lock
             return try_release_version(version_to_release);
@@ -77,7 +110,7 @@ public:
     }
 
     ResourcePointer get_resource() {
-    	ResourcePointer handler(this, _version.load());
+        ResourcePointer handler(this, _version.load(), current_thread_index() % REF_STRIPE_COUNT);
         // ˴
         // 1. _version޸, ⵽cur_ver != version
         // 2. _versionδ޸, cur_verѱü, õıͷ
@@ -92,18 +125,29 @@ public:
     }
 
 private:
-    int load_resource(void *params, bool is_reload) {
+    int load_resource(void *params, bool is_reload, bool is_delta = false) {
         std::lock_guard<std::mutex> lock(_reload_mutex);
         auto cur_version = _version.load();
         int32_t index_to_load = (is_reload ? cur_version + 1 : cur_version) & 0x01;
-        if (_refs[index_to_load].load() != 0) {
+        if (ref_count(index_to_load) != 0) {
             return RET_BUFFER_INUSE;
         }
 
-        Resource *resource = _loader(params);
+        Resource *resource = nullptr;
+        if (is_delta) {
+            // current version can not be released while reload lock held
+            const Resource* current = get_ver_resource(cur_version);
+            resource = (_delta_loader && current != nullptr) ? _delta_loader(current, params) : nullptr;
+        } else {
+            resource = _loader(params);
+        }
         if (nullptr == resource) {
             return RET_LOAD_FAIL;
         }
+        if (_warmup && !_warmup(resource)) {
+            resource_ptr_type drop(resource);
+            return RET_LOAD_FAIL;
+        }
 
         _resource_container[index_to_load].reset(resource);
         _version.store(index_to_load);
@@ -115,23 +159,34 @@ private:
 
     // should be under lock
     int try_release_version(int32_t version_to_release) {
-        if (version_to_release == _version.load()) {
+        if ((version_to_release & 0x01) == (_version.load() & 0x01)) {
             return RET_BUFFER_INUSE;
         }
         int32_t index = version_to_release & 0x01;
-        if (_refs[index].load() != 0 || _resource_container[index] == nullptr) {
+        if (ref_count(index) != 0 || _resource_container[index] == nullptr) {
             return RET_BUFFER_INUSE;
         }
         _resource_container[index].reset();
         return RET_SUCC;
     }
 
-    ref_count_t ref_version(version_t version) {
-        return ++_refs[version & 0x01];
+    ref_count_t ref_count(version_t version) const {
+        ref_count_t count = 0;
+        for (size_t i = 0; i < REF_STRIPE_COUNT; ++i) {
+            count += _refs[version & 0x01][i].count.load();
+        }
+        return count;
+    }
+
+    ref_count_t ref_version(version_t version, size_t stripe) {
+        return ++_refs[version & 0x01][stripe].count;
     }
-    ref_count_t unref_version(version_t version) {
-        ref_count_t ref_count = --_refs[version & 0x01];
-        release_unused();
+    ref_count_t unref_version(version_t version, size_t stripe) {
+        ref_count_t ref_count = --_refs[version & 0x01][stripe].count;
+        // only the last ref of a stripe on a replaced version may free it
+        if (ref_count == 0 && (version & 0x01) != (_version.load() & 0x01)) {
+            release_unused();
+        }
         return ref_count;
     }
 
@@ -146,8 +201,10 @@ private:
 private:
     std::mutex _reload_mutex;
     ResourceLoader _loader;
+    DeltaLoader _delta_loader;
+    WarmupFunc _warmup;
     std::atomic<version_t> _version;
-    std::atomic<ref_count_t> _refs[2];
+    RefStripe _refs[2][REF_STRIPE_COUNT];
     resource_ptr_type _resource_container[2]; // duel buffer
 };
 
@@ -160,33 +217,35 @@ private:
     friend class Reloadable<Resource>;
 
     // acccess by Reloadable only
-    ResourceHandle(Reloadable<Resource>* reloadable, version_t version)
+    ResourceHandle(Reloadable<Resource>* reloadable, version_t version, size_t stripe)
        : _reloadable(reloadable),
-         _version(version) {
+         _version(version),
+         _stripe(stripe) {
         if (_reloadable != nullptr) {
-            _reloadable->ref_version(_version);
+            _reloadable->ref_version(_version, _stripe);
         }
     }
 
 public:
     typedef Resource ResourceType;
 
-    ResourceHandle() : _reloadable(nullptr), _version(0) {}
+    ResourceHandle() : _reloadable(nullptr), _version(0), _stripe(0) {}
 
+    // copy refs on the stripe of other
     ResourceHandle(const ResourceHandle& other)
         : _reloadable(other._reloadable),
-          _version(other._version) {
+          _version(other._version),
+          _stripe(other._stripe) {
         if (_reloadable != nullptr) {
-            _reloadable->ref_version(_version);
+            _reloadable->ref_version(_version, _stripe);
         }
     }
 
+    // take over the ref of other
     ResourceHandle(ResourceHandle&& other)
         : _reloadable(other._reloadable),
-          _version(other._version) {
-        if (_reloadable != nullptr) {
-            _reloadable->ref_version(_version);
-        }
+          _version(other._version),
+          _stripe(other._stripe) {
         other._reloadable = nullptr;
         other._version = 0;
     }
@@ -201,8 +260,9 @@ public:
             release();
             _reloadable = other._reloadable;
             _version = other._version;
+            _stripe = other._stripe;
             if (_reloadable != nullptr) {
-                _reloadable->ref_version(_version);
+                _reloadable->ref_version(_version, _stripe);
             }
         }
         return *this;
@@ -214,17 +274,16 @@ public:
             release();
             _reloadable = other._reloadable;
             _version = other._version;
-            if (_reloadable != nullptr) {
-                _reloadable->ref_version(_version);
-            }
-            other.release();
+            _stripe = other._stripe;
+            other._reloadable = nullptr;
+            other._version = 0;
         }
         return *this;
     }
 
     void release() {
         if (_reloadable != nullptr) {
-            _reloadable->unref_version(_version);
+            _reloadable->unref_version(_version, _stripe);
             _reloadable = nullptr;
         }
     }
@@ -258,7 +317,7 @@ public:
     }
 
     explicit operator bool() const noexcept {
-        return is_null();
+        return !is_null();
     }
 
 private:
@@ -266,8 +325,8 @@ private:
 
     void rebind_version(version_t new_version) {
         if (new_version != _version) {
-            _reloadable->ref_version(new_version);
-            _reloadable->unref_version(_version);
+            _reloadable->ref_version(new_version, _stripe);
+            _reloadable->unref_version(_version, _stripe);
             _version = new_version;
         }
     }
@@ -275,6 +334,7 @@ private:
 private:
     Reloadable<Resource>* _reloadable;
     version_t _version;
+    size_t _stripe;
 };
  
 } // end namespace common
@@ -0,0 +1,107 @@
+/**
+ * @file scheduler_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-08 16:02:33
+ * @brief ReloadScheduler测试, 文件变化触发reload, 连续修改合并, 版本被占用时重试
+ *
+ **/
+
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "reload_scheduler.h"
+#include "reloadable.h"
+#include "timer.h"
+
+using namespace common;
+
+static const char* kDataPath = "./scheduler_test.data";
+
+struct Resource {
+    std::string content;
+};
+
+static Resource* load_file(void* params) {
+    std::ifstream input(static_cast<const char*>(params));
+    if (!input) {
+        return nullptr;
+    }
+    Resource* resource = new Resource();
+    std::getline(input, resource->content);
+    return resource;
+}
+
+static void write_file(const std::string& content) {
+    std::ofstream output(kDataPath, std::ios::trunc);
+    output << content << std::endl;
+}
+
+static std::string current(Reloadable<Resource>* reloadable) {
+    return reloadable->get_resource()->content;
+}
+
+int main(int argc, char** argv) {
+    write_file("v0");
+    Reloadable<Resource> reloadable;
+    reloadable.set_resource_loader(&load_file);
+    int ret = reloadable.init(const_cast<char*>(kDataPath));
+    assert(ret == RET_SUCC);
+    (void)ret;
+
+    ReloadSchedulerOptions options;
+    options.debounce_ms = 50;
+    options.retry_interval_ms = 20;
+    ReloadScheduler scheduler(options);
+    int watch_id = scheduler.watch(kDataPath, &reloadable, const_cast<char*>(kDataPath));
+    assert(watch_id >= 0);
+    bool started = scheduler.start();
+    assert(started);
+    (void)started;
+
+    // a burst of writes is merged
+    for (int i = 1; i <= 10; ++i) {
+        write_file("v" + std::to_string(i));
+    }
+    std::this_thread::sleep_for(Milliseconds(200));
+    std::string content = current(&reloadable);
+    assert(content == "v10");
+    ReloadStats stats;
+    bool found = scheduler.get_stats(watch_id, &stats);
+    assert(found);
+    std::cout << "reload count after burst: " << stats.reload_count
+              << ", latency: " << stats.last_latency_us << "us" << std::endl;
+    assert(stats.reload_count >= 1 && stats.reload_count <= 2);
+
+    // old version held by a reader, reload retries until released
+    auto holder = reloadable.get_resource();
+    write_file("v11");
+    std::this_thread::sleep_for(Milliseconds(200));
+    content = current(&reloadable);
+    assert(content == "v11");
+    write_file("v12");
+    std::this_thread::sleep_for(Milliseconds(200));
+    content = current(&reloadable);
+    assert(content == "v11");
+    holder.release();
+    std::this_thread::sleep_for(Milliseconds(100));
+    content = current(&reloadable);
+    assert(content == "v12");
+    found = scheduler.get_stats(watch_id, &stats);
+    assert(found);
+    (void)found;
+    (void)content;
+    std::cout << "reload count: " << stats.reload_count << ", retry count: " << stats.retry_count
+              << ", version age: " << scheduler.version_age_ms(watch_id) << "ms" << std::endl;
+    assert(stats.retry_count > 0);
+    assert(stats.fail_count == 0);
+
+    scheduler.stop();
+    unlink(kDataPath);
+    std::cout << "done" << std::endl;
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
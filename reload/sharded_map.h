@@ -0,0 +1,121 @@
+/**
+ * @file sharded_map.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-02 14:20:35
+ * @brief 分片的不可变map, 增量更新时只复制被修改的分片, 其余分片与旧版本共享
+ *        配合Reloadable::reload_delta使用
+ **/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace common {
+
+template<typename Key, typename Value, typename Hash = std::hash<Key> >
+class ShardedMap {
+public:
+    typedef std::unordered_map<Key, Value, Hash> Shard;
+    typedef std::shared_ptr<const Shard> ShardPtr;
+
+    static const size_t DEFAULT_SHARD_COUNT = 256;
+
+    // copy on write builder
+    // unchanged shards of base are shared by the built map
+    class Builder {
+    public:
+        explicit Builder(size_t shard_count = DEFAULT_SHARD_COUNT)
+            : _shards(shard_count == 0 ? 1 : shard_count), _owned(_shards.size(), true) {
+            for (auto& shard : _shards) {
+                shard = std::make_shared<Shard>();
+            }
+        }
+
+        explicit Builder(const ShardedMap& base)
+            : _shards(base._shards), _owned(_shards.size(), false) {}
+
+        void set(const Key& key, const Value& value) {
+            (*mutable_shard(key))[key] = value;
+        }
+
+        void set(const Key& key, Value&& value) {
+            (*mutable_shard(key))[key] = std::move(value);
+        }
+
+        void erase(const Key& key) {
+            size_t index = shard_of(key, _shards.size());
+            if (_shards[index]->count(key) > 0) {
+                mutable_shard(key)->erase(key);
+            }
+        }
+
+        ShardedMap* build() {
+            ShardedMap* map = new (std::nothrow) ShardedMap(std::move(_shards));
+            _shards.clear();
+            _owned.clear();
+            return map;
+        }
+
+    private:
+        Shard* mutable_shard(const Key& key) {
+            size_t index = shard_of(key, _shards.size());
+            if (!_owned[index]) {
+                _shards[index] = std::make_shared<Shard>(*_shards[index]);
+                _owned[index] = true;
+            }
+            return const_cast<Shard*>(_shards[index].get());
+        }
+
+        std::vector<ShardPtr> _shards;
+        // shards copied by this builder, safe to modify
+        std::vector<bool> _owned;
+    };
+
+    // empty map, all shards share one empty shard
+    ShardedMap() : _shards(DEFAULT_SHARD_COUNT, std::make_shared<Shard>()) {}
+
+    const Value* find(const Key& key) const {
+        const Shard& shard = *_shards[shard_of(key, _shards.size())];
+        auto iter = shard.find(key);
+        return iter == shard.end() ? nullptr : &iter->second;
+    }
+
+    size_t size() const {
+        size_t size = 0;
+        for (const auto& shard : _shards) {
+            size += shard->size();
+        }
+        return size;
+    }
+
+    size_t shard_count() const {
+        return _shards.size();
+    }
+
+    const Shard& shard(size_t index) const {
+        return *_shards[index];
+    }
+
+    // whether the index-th shard is shared with other
+    bool shares_shard(const ShardedMap& other, size_t index) const {
+        return index < _shards.size() && index < other._shards.size()
+                && _shards[index] == other._shards[index];
+    }
+
+private:
+    explicit ShardedMap(std::vector<ShardPtr>&& shards) : _shards(std::move(shards)) {}
+
+    static size_t shard_of(const Key& key, size_t shard_count) {
+        return Hash()(key) % shard_count;
+    }
+
+    std::vector<ShardPtr> _shards;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,140 @@
+/**
+ * @file warmup.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-12 10:17:44
+ * @brief reload预热工具
+ *        touch_pages: 新版本发布前访问内存页, 避免读者触发缺页
+ *        KeySampler: 采样读者最近访问的key, ReplayWarmup在新版本上并行回放
+ **/
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_pool/thread_index.h"
+
+namespace common {
+
+// fault in pages of [addr, addr + len) by reading a byte per page
+inline void touch_pages(const void* addr, size_t len) {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    if (addr == nullptr || len == 0) {
+        return;
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(page_size - 1);
+    madvise(reinterpret_cast<void*>(begin), reinterpret_cast<uintptr_t>(addr) + len - begin,
+            MADV_WILLNEED);
+    const volatile char* p = static_cast<const volatile char*>(addr);
+    char sum = 0;
+    for (size_t offset = 0; offset < len; offset += page_size) {
+        sum += p[offset];
+    }
+    sum += p[len - 1];
+    (void)sum;
+}
+
+// samples keys accessed by readers into per-thread-stripe rings
+// record is cheap: one in sample_rate calls takes a try-lock, contended samples are dropped
+template<typename Key>
+class KeySampler {
+public:
+    explicit KeySampler(size_t capacity = 1024, uint32_t sample_rate = 64)
+        : _sample_rate(sample_rate == 0 ? 1 : sample_rate),
+          _stripe_capacity(std::max(capacity / STRIPE_COUNT, static_cast<size_t>(1))) {}
+
+    void record(const Key& key) {
+        static thread_local uint32_t t_calls = 0;
+        if (++t_calls % _sample_rate != 0) {
+            return;
+        }
+        Stripe& stripe = _stripes[current_thread_index() % STRIPE_COUNT];
+        std::unique_lock<std::mutex> lock(stripe.mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+        if (stripe.keys.size() < _stripe_capacity) {
+            stripe.keys.push_back(key);
+        } else {
+            stripe.keys[stripe.next] = key;
+        }
+        stripe.next = (stripe.next + 1) % _stripe_capacity;
+    }
+
+    // copy of the sampled keys
+    std::vector<Key> keys() const {
+        std::vector<Key> keys;
+        for (const Stripe& stripe : _stripes) {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            keys.insert(keys.end(), stripe.keys.begin(), stripe.keys.end());
+        }
+        return keys;
+    }
+
+private:
+    static const size_t STRIPE_COUNT = 16;
+
+    struct alignas(64) Stripe {
+        Stripe() : next(0) {}
+
+        mutable std::mutex mutex;
+        std::vector<Key> keys;
+        size_t next;
+    };
+
+    const uint32_t _sample_rate;
+    const size_t _stripe_capacity;
+    Stripe _stripes[STRIPE_COUNT];
+};
+
+// WarmupFunc replaying sampled keys on the new resource in thread_num threads
+// lookup should do what readers do, e.g. a find that fills lazy caches
+template<typename Resource, typename Key>
+class ReplayWarmup {
+public:
+    typedef std::function<void (Resource*, const Key&)> LookupFunc;
+
+    ReplayWarmup(const KeySampler<Key>* sampler, const LookupFunc& lookup, uint32_t thread_num = 1)
+        : _sampler(sampler), _lookup(lookup), _thread_num(thread_num == 0 ? 1 : thread_num) {}
+
+    bool operator ()(Resource* resource) const {
+        std::vector<Key> keys = _sampler->keys();
+        size_t thread_num = std::min(static_cast<size_t>(_thread_num), keys.size());
+        if (thread_num <= 1) {
+            replay(resource, keys, 0, 1);
+            return true;
+        }
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < thread_num; ++i) {
+            threads.emplace_back(&ReplayWarmup::replay, this, resource, std::cref(keys), i, thread_num);
+        }
+        replay(resource, keys, 0, thread_num);
+        for (auto& t : threads) {
+            t.join();
+        }
+        return true;
+    }
+
+private:
+    void replay(Resource* resource, const std::vector<Key>& keys, size_t begin, size_t step) const {
+        for (size_t i = begin; i < keys.size(); i += step) {
+            _lookup(resource, keys[i]);
+        }
+    }
+
+    const KeySampler<Key>* _sampler;
+    LookupFunc _lookup;
+    uint32_t _thread_num;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
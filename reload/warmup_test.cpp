@@ -0,0 +1,104 @@
+/**
+ * @file warmup_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-12 15:36:20
+ * @brief 预热测试, 新版本在发布前回放采样的key, 预热失败时保留旧版本
+ *
+ **/
+
+#include <assert.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "epoch_reloadable.h"
+#include "reloadable.h"
+#include "warmup.h"
+
+using namespace common;
+
+static const size_t kKeyNum = 1000;
+static const size_t kReaderNum = 4;
+
+static size_t g_version = 0;
+
+// lookups of cold keys are slow until warmed up
+struct Resource {
+    Resource() : version(++g_version), warmed(kKeyNum) {
+        for (auto& w : warmed) {
+            w = 0;
+        }
+    }
+
+    size_t version;
+    std::vector<std::atomic<int> > warmed;
+};
+
+template<typename ReloadableType>
+static void test_warmup(ReloadableType* reloadable) {
+    KeySampler<size_t> sampler(256, 4);
+    // readers access keys 0..9 only
+    std::vector<std::thread> readers;
+    for (size_t i = 0; i < kReaderNum; ++i) {
+        readers.emplace_back([&sampler, i]() {
+            for (size_t n = 0; n < 10000; ++n) {
+                sampler.record((n + i) % 10);
+            }
+        });
+    }
+    for (auto& t : readers) {
+        t.join();
+    }
+    std::vector<size_t> keys = sampler.keys();
+    assert(!keys.empty() && keys.size() <= 256);
+
+    size_t published = 0;
+    ReplayWarmup<Resource, size_t> replay(&sampler,
+            [](Resource* resource, const size_t& key) { resource->warmed[key] = 1; }, 4);
+    reloadable->set_warmup([&](Resource* resource) {
+        // not visible to readers yet
+        published = reloadable->get_resource()->version;
+        assert(published != resource->version);
+        touch_pages(resource->warmed.data(), resource->warmed.size() * sizeof(std::atomic<int>));
+        return replay(resource);
+    });
+    int ret = reloadable->reload(nullptr);
+    assert(ret == RET_SUCC);
+    {
+        auto handle = reloadable->get_resource();
+        assert(handle->version != published);
+        for (size_t key = 0; key < kKeyNum; ++key) {
+            assert(handle->warmed[key] == (key < 10 ? 1 : 0));
+        }
+    }
+
+    // failed warmup keeps the current version
+    size_t current = reloadable->get_resource()->version;
+    reloadable->set_warmup([](Resource*) { return false; });
+    ret = reloadable->reload(nullptr);
+    assert(ret == RET_LOAD_FAIL);
+    (void)ret;
+    assert(reloadable->get_resource()->version == current);
+    (void)current;
+}
+
+int main(int argc, char** argv) {
+    {
+        Reloadable<Resource> reloadable;
+        int ret = reloadable.init(nullptr);
+        assert(ret == RET_SUCC);
+        (void)ret;
+        test_warmup(&reloadable);
+    }
+    {
+        EpochReloadable<Resource> reloadable;
+        int ret = reloadable.init(nullptr);
+        assert(ret == RET_SUCC);
+        (void)ret;
+        test_warmup(&reloadable);
+    }
+    std::cout << "done" << std::endl;
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
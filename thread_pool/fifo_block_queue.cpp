@@ -8,16 +8,27 @@
  
 #include "thread_pool/fifo_block_queue.h"
 
+#include <algorithm>
 #include <thread>
 
 #include "thread_pool/task_queue_factory.h"
  
 namespace common {
+
+// producers fetch and workers give back task info all the time,
+// cache some in magazines while the pool is large enough to share
+static InstancePoolOptions task_pool_options(size_t capacity) {
+    static const size_t MAX_MAGAZINE_SIZE = 32;
+    size_t threads = std::max(1U, std::thread::hardware_concurrency());
+    InstancePoolOptions options(capacity);
+    options.magazine_size = std::min(MAX_MAGAZINE_SIZE, capacity / (threads << 1));
+    return options;
+}
  
 FifoBlockQueue::FifoBlockQueue(uint32_t capacity)
     : TaskQueue(),
       _queue(capacity),
-      _pool(_queue.capacity()) {}
+      _pool(task_pool_options(_queue.capacity())) {}
 
 FifoBlockQueue::~FifoBlockQueue() {
     for (size_t i = 0; i < _queue.capacity(); ++i) {
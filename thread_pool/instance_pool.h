@@ -11,13 +11,22 @@
 #include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
-#include <map>
 #include <memory>
-#include <mutex>
+#include <new>
+#include <thread>
 #include <type_traits>
 #include <utility>
 
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "thread_pool/thread_index.h"
+#include "thread_pool/timer.h"
+
 #ifdef __DEBUG_INSTANCE_POOL__
 #include <com_log.h>
 #define PRINT_DEBUG(fmt, args...) \
@@ -44,61 +53,60 @@ struct lowest_bit<0> {
     };
 };
 
-inline uint8_t lowest_bit_8(uint8_t val) {
-    uint8_t pos = 0;
-    if ((val & 0x0f) == 0) {
-        pos += 4;
-        val >>= 4;
-    }
-
-    if ((val & 0x03) == 0) {
-        pos += 2;
-        val >>= 2;
-    }
-
-    if ((val & 0x01) == 0) {
-        pos += 1;
-        val >>= 1;
-    }
-
-    return pos;
-}
-
-inline uint8_t lowest_bit_8_table(uint8_t val) {
-    static uint8_t _s_table[256];
-    static std::once_flag _s_init_once_flag;
-
-    std::call_once(_s_init_once_flag,
-            [] (uint8_t* table, size_t size) {
-                PRINT_DEBUG("init lowest bit table");
-                table[0] = 0;
-                for (size_t i = 1; i < size; ++i) {
-                    table[i] = lowest_bit_8(static_cast<uint8_t>(i));
-                }
-            },
-            _s_table, 256);
-    return _s_table[val];
-}
-
+// lowest set bit by hardware ctz, data must not be 0
 template<typename UIntType>
 inline uint8_t lowest_bit_pos(UIntType data) {
-    uint8_t pos = 0;
-    for (size_t i = 0; i < sizeof(UIntType); ++i) {
-        if ((data & 0xff) == 0) {
-            pos += 8;
-            data >>= 8;
-        } else {
-            return pos + lowest_bit_8_table(data);
-        }
+    static_assert(std::is_unsigned<UIntType>::value && sizeof(UIntType) <= sizeof(unsigned long long),
+            "lowest_bit_pos only accepts unsigned integer no wider than 64 bits");
+    if (sizeof(UIntType) <= sizeof(unsigned int)) {
+        return static_cast<uint8_t>(__builtin_ctz(static_cast<unsigned int>(data)));
+    } else if (sizeof(UIntType) <= sizeof(unsigned long)) {
+        return static_cast<uint8_t>(__builtin_ctzl(static_cast<unsigned long>(data)));
+    } else {
+        return static_cast<uint8_t>(__builtin_ctzll(static_cast<unsigned long long>(data)));
     }
-    return 0;
 }
-// specialize for uint_8
-template<>
-inline uint8_t lowest_bit_pos<uint8_t>(uint8_t data) {
-    return lowest_bit_8_table(data);
+
+// mask with lowest n bits set, n can be the full width of UIntType
+template<typename UIntType>
+inline UIntType lowest_bits_mask(size_t n) {
+    return n >= (sizeof(UIntType) << 3) ? ~static_cast<UIntType>(0)
+            : static_cast<UIntType>((static_cast<UIntType>(1) << n) - 1);
 }
 
+struct InstancePoolOptions {
+    // instances per arena, the first arena is preallocated
+    size_t capacity;
+    // arenas at most, others are added when the pool runs out
+    // 1 for a fixed size pool. once all arenas run out, fetch and fetch_fast_fail fall back
+    // to malloc while try_fetch returns nullptr
+    size_t max_arenas;
+    // memory of an added arena is released after all instances are given back for this long,
+    // checked by give_back periodically, call release_idle_arenas if the pool is unused then
+    int64_t arena_idle_ms;
+    // free instances cached per magazine, 0 to disable magazines
+    size_t magazine_size;
+    // threads share magazines by thread index, 0 as hardware concurrency
+    size_t magazine_count;
+    // round instance stride up to cache line, neighbours never share a line
+    bool cache_line_aligned;
+    // back arenas by huge pages, MAP_HUGETLB if reserved in system, or else MADV_HUGEPAGE
+    bool huge_page;
+    // bind arena memory to the numa node, -1 for default policy
+    int numa_node;
+
+    // implicit, so a capacity can be passed where options are expected
+    InstancePoolOptions(size_t pool_capacity = 0)
+            : capacity(pool_capacity),
+              max_arenas(1),
+              arena_idle_ms(10000),
+              magazine_size(0),
+              magazine_count(0),
+              cache_line_aligned(false),
+              huge_page(false),
+              numa_node(-1) {}
+};
+
 template<class T>
 struct type_trait {
     using element_type = typename std::remove_reference<T>::type;
@@ -132,6 +140,43 @@ default_deconstructor(typename type_trait<T>::pointer p) {
     }
 }
 
+template<class T, class... Args>
+class InstancePool;
+
+// storage of shared_ptr control block, which holds counts, pointer, deleter and allocator
+struct alignas(64) ControlBlock {
+    char data[64];
+};
+using ControlBlockPool = InstancePool<ControlBlock>;
+
+// allocates shared_ptr control blocks from a pool, so fetch_shared never touches heap
+template<typename U>
+struct ControlBlockAllocator {
+    using value_type = U;
+    template<typename V>
+    struct rebind {
+        using other = ControlBlockAllocator<V>;
+    };
+
+    explicit ControlBlockAllocator(ControlBlockPool* block_pool) : pool(block_pool) {}
+    template<typename V>
+    ControlBlockAllocator(const ControlBlockAllocator<V>& other) : pool(other.pool) {}
+
+    U* allocate(size_t n);
+    void deallocate(U* p, size_t n);
+
+    template<typename V>
+    bool operator == (const ControlBlockAllocator<V>& other) const {
+        return pool == other.pool;
+    }
+    template<typename V>
+    bool operator != (const ControlBlockAllocator<V>& other) const {
+        return pool != other.pool;
+    }
+
+    ControlBlockPool* pool;
+};
+
 template<class T, class... Args>
 class InstancePool {
 public:
@@ -154,7 +199,7 @@ public:
     using shared_pointer = std::shared_ptr<element_type>;
 
 private:
-    using slot_type = uint8_t;
+    using slot_type = uint64_t;
     using slot_index_type = uint32_t;
 
     // constants
@@ -167,7 +212,51 @@ private:
     // max instance count
     static const size_t MAX_CAPACITY = MAX_SLOT_COUNT * SLOT_CAPACITY;
 
-    static const slot_type SLOT_INITIALIZER = ~static_cast<slot_type>(0);
+    // slot words are padded to cache line, fetchers on different slots never share a line
+    static const size_t CACHE_LINE_SIZE = 64;
+    static const size_t HUGE_PAGE_SIZE = 2UL << 20;
+    // give_backs between two checks of idle arenas
+    static const size_t IDLE_CHECK_INTERVAL = 1024;
+    struct alignas(CACHE_LINE_SIZE) AlignedSlot {
+        std::atomic<slot_type> bits;
+    };
+
+    enum ArenaState {
+        ARENA_EMPTY = 0,
+        ARENA_GROWING,
+        ARENA_ACTIVE,
+        ARENA_RETIRING,
+    };
+
+    // fixed size block of instances with its own bitmap
+    // arena structs live as long as the pool, only instance memory is released
+    struct alignas(CACHE_LINE_SIZE) Arena {
+        std::atomic<int> state;
+        char* start;
+        // two level bitmap: bit in slots for instance, bit in summary for non-empty slot
+        AlignedSlot* slots;
+        AlignedSlot* summary;
+        std::atomic<size_t> availablity;
+        // round robin between summary words
+        std::atomic<slot_index_type> slot_rr;
+        // time in ms when all instances were given back
+        std::atomic<int64_t> idle_since;
+    };
+
+    // deleter of smart pointers, small enough to be stored in std::function without allocation
+    struct GiveBack {
+        InstancePool* pool;
+        void operator()(pointer p) const {
+            pool->give_back(p);
+        }
+    };
+
+    // lifo stack of free instances, refilled from and flushed to slots in batch
+    struct alignas(CACHE_LINE_SIZE) Magazine {
+        std::atomic<bool> locked;
+        size_t size;
+        pointer* items;
+    };
 
     static inline size_t slots_capacity(size_t capacity) {
         return capacity == 0 ? 0 : ((capacity - 1) / SLOT_CAPACITY) + 1;
@@ -182,16 +271,70 @@ private:
         return lowest_bit_pos<slot_type>(data);
     }
 
+    // zero filled and cache line aligned, release by free()
+    template<typename Type>
+    static Type* new_aligned(size_t count) {
+        void* mem = nullptr;
+        if (count == 0 || 0 != posix_memalign(&mem, CACHE_LINE_SIZE, count * sizeof(Type))) {
+            return nullptr;
+        }
+        memset(mem, 0, count * sizeof(Type));
+        return reinterpret_cast<Type*>(mem);
+    }
+
+    // set lowest bits_count bits of slot words
+    static void fill_slots(AlignedSlot* slots, size_t count, size_t bits_count) {
+        for (size_t i = 0; i < count; ++i) {
+            size_t remain = bits_count - std::min(bits_count, i * SLOT_CAPACITY);
+            slots[i].bits.store(lowest_bits_mask<slot_type>(remain));
+        }
+    }
+
+    static size_t stride_of(const InstancePoolOptions& options) {
+        size_t stride = sizeof(element_type);
+        if (options.cache_line_aligned) {
+            stride = ((stride - 1) / CACHE_LINE_SIZE + 1) * CACHE_LINE_SIZE;
+        }
+        return stride;
+    }
+
+    // best effort, memory keeps default policy if failed
+    static void bind_numa_node(void* addr, size_t len, int node) {
+        // MPOL_BIND in numaif.h, called by syscall to avoid depending on libnuma
+        static const int MPOL_BIND_MODE = 2;
+        unsigned long nodemask[16] = {0};
+        static const size_t MASK_BITS = sizeof(nodemask) << 3;
+        static const size_t WORD_BITS = sizeof(unsigned long) << 3;
+        if (node < 0 || static_cast<size_t>(node) >= MASK_BITS) {
+            return;
+        }
+        nodemask[node / WORD_BITS] |= (0x01UL << (node % WORD_BITS));
+        long ret = syscall(SYS_mbind, addr, len, MPOL_BIND_MODE, nodemask, MASK_BITS + 1, 0);
+        if (ret != 0) {
+            PRINT_DEBUG("mbind %p to node %d failed", addr, node);
+        }
+    }
+
+    static size_t magazine_count_of(const InstancePoolOptions& options) {
+        if (options.magazine_size == 0) {
+            return 0;
+        }
+        if (options.magazine_count > 0) {
+            return options.magazine_count;
+        }
+        return std::max(1U, std::thread::hardware_concurrency());
+    }
+
 public:
     // TҪпɼĹ캯
-    explicit InstancePool(size_t capacity)
-        : InstancePool(capacity, nullptr, nullptr, &default_constructor<T, Args...>, &default_deconstructor<T>) {}
+    explicit InstancePool(const InstancePoolOptions& options)
+        : InstancePool(options, nullptr, nullptr, &default_constructor<T, Args...>, &default_deconstructor<T>) {}
 
     // TҪпɼĹ캯
     template<typename Initializer, typename Uninitializer>
-    InstancePool(size_t capacity,
+    InstancePool(const InstancePoolOptions& options,
             Initializer&& initializer, Uninitializer&& uninitializer)
-        : InstancePool(capacity,
+        : InstancePool(options,
                 std::forward<Initializer>(initializer),
                 std::forward<Uninitializer>(uninitializer),
                 &default_constructor<T, Args...>,
@@ -199,18 +342,31 @@ public:
 
     // д빹, TĹ캯publicĳ
     template<typename Initializer, typename Uninitializer, typename Constructor, typename Deconstructor>
-    InstancePool(size_t capacity,
+    InstancePool(const InstancePoolOptions& options,
             Initializer&& initializer,
             Uninitializer&& uninitializer,
             Constructor&& constructor,
             Deconstructor&& deconstructor)
-            : _capacity(std::min(static_cast<size_t>(MAX_CAPACITY), capacity)),
+            : _capacity(std::min(static_cast<size_t>(MAX_CAPACITY), options.capacity)),
               _slot_count(slots_capacity(_capacity)),
-              _start(nullptr),
-              _end(nullptr),
-              _availablity(_capacity),
-              _slot_rr(0),
-              _slots(nullptr),
+              _summary_count(slots_capacity(_slot_count)),
+              _max_arenas(_capacity > 0 ? std::max(static_cast<size_t>(1), options.max_arenas) : 0),
+              _arena_idle_ms(options.arena_idle_ms),
+              _magazine_size(_capacity > 0 ? options.magazine_size : 0),
+              _magazine_count(_capacity > 0 ? magazine_count_of(options) : 0),
+              _stride(stride_of(options)),
+              _huge_page(options.huge_page),
+              _numa_node(options.numa_node),
+              _arena_bytes(0),
+              _base(nullptr),
+              _arenas(nullptr),
+              _availablity(0),
+              _growing(false),
+              _idle_check_tick(0),
+              _magazines(nullptr),
+              _magazine_items(nullptr),
+              _control_blocks(nullptr),
+              _options(options),
               _initializer(std::forward<Initializer>(initializer)),
               _uninitializer(std::forward<Uninitializer>(uninitializer)),
               _constructor(std::forward<Constructor>(constructor)),
@@ -237,82 +393,79 @@ public:
 
     // find all slot
     pointer fetch(Args&&... args) {
-        if (!_start || availablity() == 0) {
-            PRINT_DEBUG("availablity == 0, just new");
-            return allocate_and_construct(std::forward<Args>(args)...);
-        }
-        slot_index_type start_index = (_slot_rr++) % _slot_count;
-        for (slot_index_type i = start_index; i < _slot_count; ++i) {
-            pointer p = fetch_in_slot(i);
-            if (p != nullptr) {
-                return _constructor(p, std::forward<Args>(args)...);
-            }
-        }
-        for (slot_index_type i = 0; i < start_index; ++i) {
-            pointer p = fetch_in_slot(i);
-            if (p != nullptr) {
-                return _constructor(p, std::forward<Args>(args)...);
-            }
+        pointer p = fetch_from_magazine();
+        if (p != nullptr || fetch_from_arenas(&p, 1, false) > 0) {
+            return _constructor(p, std::forward<Args>(args)...);
         }
 
         PRINT_DEBUG("availablity == 0, just new");
         return allocate_and_construct(std::forward<Args>(args)...);
     }
 
-    // find one slot only
+    // find one summary word of each arena only, malloc if nothing found
     pointer fetch_fast_fail(Args&&... args) {
-        if (!_start || availablity() == 0) {
-            PRINT_DEBUG("availablity == 0, just new");
-            return allocate_and_construct(std::forward<Args>(args)...);
-        }
-        slot_index_type start_index = (_slot_rr++) % _slot_count;
-        pointer p = fetch_in_slot(start_index);
-        if (p != nullptr) {
+        pointer p = fetch_from_magazine();
+        if (p != nullptr || fetch_from_arenas(&p, 1, true) > 0) {
             return _constructor(p, std::forward<Args>(args)...);
         }
 
-        PRINT_DEBUG("availablity == 0, just new");
+        PRINT_DEBUG("no instance found, just new");
         return allocate_and_construct(std::forward<Args>(args)...);
     }
 
+    // same search as fetch_fast_fail, but never malloc
+    // return nullptr if nothing found, e.g. all arenas up to max_arenas run out
+    pointer try_fetch(Args&&... args) {
+        pointer p = fetch_from_magazine();
+        if (p != nullptr || fetch_from_arenas(&p, 1, true) > 0) {
+            return _constructor(p, std::forward<Args>(args)...);
+        }
+
+        PRINT_DEBUG("no instance found, fail fast");
+        return nullptr;
+    }
+
     void give_back(pointer p) {
-        ssize_t index = index_of(p);
-        if (index < 0) {
+        Arena* arena = nullptr;
+        size_t index = 0;
+        if (!locate(p, &arena, &index)) {
             // not in pool, just delete
-            PRINT_DEBUG("%p not in [%p-%p], just delete", p, _start, _end);
+            PRINT_DEBUG("%p not in pool, just delete", p);
             deconstruct_and_free(p);
         } else {
             auto slot_pair = slot_of(index);
-            PRINT_DEBUG("give back %p [%p-%p] %ld to slot[%u-%u]",
-                    p, _start, _end, index, slot_pair.first, slot_pair.second);
+            PRINT_DEBUG("give back %p %ld to arena %ld slot[%u-%u]",
+                    p, index, arena - _arenas, slot_pair.first, slot_pair.second);
 
             // call deconstructor firstly
             _deconstructor(p);
 
-            // set index available
-            _slots[slot_pair.first] |= (0x01 << slot_pair.second);
+            if (give_back_to_magazine(p)) {
+                return;
+            }
 
-            // incr availablity
-            ++_availablity;
+            // set index available
+            give_back_to_arena(*arena, slot_pair.first,
+                    static_cast<slot_type>(0x01) << slot_pair.second, 1);
         }
     }
 
     // ָ
     unique_pointer fetch_unique(Args&&... args) {
         pointer p = fetch(std::forward<Args>(args)...);
-        return unique_pointer(p, std::bind(&InstancePool<T, Args...>::give_back, this, std::placeholders::_1));
+        return unique_pointer(p, GiveBack{this});
     }
     unique_pointer fetch_unique_fast_fail(Args&&... args) {
         pointer p = fetch_fast_fail(std::forward<Args>(args)...);
-        return unique_pointer(p, std::bind(&InstancePool<T, Args...>::give_back, this, std::placeholders::_1));
+        return unique_pointer(p, GiveBack{this});
     }
+    // control block is fetched from a pool of the same options
+    // empty if either the instance or the control block is not available
     shared_pointer fetch_shared(Args&&... args) {
-        pointer p = fetch(std::forward<Args>(args)...);
-        return shared_pointer(p, std::bind(&InstancePool<T, Args...>::give_back, this, std::placeholders::_1));
+        return make_shared_pointer(fetch(std::forward<Args>(args)...));
     }
     shared_pointer fetch_shared_fast_fail(Args&&... args) {
-        pointer p = fetch_fast_fail(std::forward<Args>(args)...);
-        return shared_pointer(p, std::bind(&InstancePool<T, Args...>::give_back, this, std::placeholders::_1));
+        return make_shared_pointer(fetch_fast_fail(std::forward<Args>(args)...));
     }
 
     // ԭؽ, ʡһηŻ+ȡĿ
@@ -324,15 +477,76 @@ public:
         return p;
     }
 
+    // ͷſгarena_idle_msarena, ͷŵĸ
+    // give_backÿIDLE_CHECK_INTERVAL˳һ, زٱʹʱɵ÷ڵ
+    size_t release_idle_arenas() {
+        size_t released = 0;
+        int64_t now = get_milli();
+        // the first arena is never released
+        for (size_t i = 1; i < _max_arenas; ++i) {
+            Arena& arena = _arenas[i];
+            if (arena.state.load() == ARENA_ACTIVE
+                    && arena.availablity.load() == _capacity
+                    && now - arena.idle_since.load() >= _arena_idle_ms
+                    && retire_arena(arena)) {
+                ++released;
+            }
+        }
+        return released;
+    }
+
+    // ѸmagazineлʵŻslots, طŻصĸ
+    // ߳ռõmagazineȴͷ
+    size_t flush_magazines() {
+        size_t flushed = 0;
+        for (size_t i = 0; _magazines != nullptr && i < _magazine_count; ++i) {
+            Magazine* magazine = &_magazines[i];
+            while (magazine->locked.exchange(true, std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            give_back_to_slots(magazine->items, magazine->size);
+            flushed += magazine->size;
+            magazine->size = 0;
+            unlock_magazine(magazine);
+        }
+        return flushed;
+    }
+
+    // instances cached in magazines are not counted, see flush_magazines
     size_t availablity() const {
         return _availablity.load();
     }
 
+    // instances per arena
     size_t capacity() const {
         return _capacity;
     }
 
+    // arenas holding memory now
+    size_t arena_count() const {
+        size_t count = 0;
+        for (size_t i = 0; i < _max_arenas; ++i) {
+            if (_arenas[i].state.load() == ARENA_ACTIVE) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
 private:
+    shared_pointer make_shared_pointer(pointer p) {
+        if (p == nullptr) {
+            return shared_pointer();
+        }
+        try {
+            return shared_pointer(p, GiveBack{this}, ControlBlockAllocator<ControlBlock>(control_blocks()));
+        } catch (const std::bad_alloc&) {
+            // shared_ptr calls the deleter on failure, p is already given back
+            PRINT_DEBUG("no control block for %p", p);
+            return shared_pointer();
+        }
+    }
+
     pointer allocate_and_construct(Args&&... args) {
         pointer p = reinterpret_cast<pointer>(malloc(sizeof(element_type)));
         if (_initializer) {
@@ -349,89 +563,486 @@ private:
         free(p);
     }
 
-    ssize_t index_of(pointer p) {
-        ssize_t index = -1;
-        if (_start && p >= _start && p < _end) {
-            index = p - _start;
+    // arenas are laid out one by one in a reserved address range,
+    // so owner arena of an instance is found by its offset
+    bool locate(pointer p, Arena** arena, size_t* index) {
+        char* addr = reinterpret_cast<char*>(p);
+        if (!_base || addr < _base || addr >= _base + _max_arenas * _arena_bytes) {
+            return false;
         }
-        return index;
+        size_t offset = addr - _base;
+        *arena = &_arenas[offset / _arena_bytes];
+        *index = (offset % _arena_bytes) / _stride;
+        return *index < _capacity;
     }
 
     void init() {
-        lowest_bit_8_table(1);
         if (_capacity > 0) {
-            _start = reinterpret_cast<pointer>(malloc(_capacity * sizeof(element_type)));
-            _end = _start + _capacity;
+            // reserve address range for all arenas, memory is committed when arena grows
+            // arenas are aligned to huge page if asked, so each one can be mapped by huge pages
+            static const size_t page_size = sysconf(_SC_PAGESIZE);
+            size_t align = (_huge_page && HUGE_PAGE_SIZE > page_size) ? HUGE_PAGE_SIZE : page_size;
+            _arena_bytes = ((_capacity * _stride - 1) / align + 1) * align;
+            size_t reserve_bytes = _max_arenas * _arena_bytes + align - page_size;
+            void* mem = mmap(nullptr, reserve_bytes, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (mem == MAP_FAILED) {
+                return;
+            }
+            // trim the unaligned head and tail
+            char* reserved = reinterpret_cast<char*>(mem);
+            _base = reinterpret_cast<char*>(((reinterpret_cast<uintptr_t>(mem) - 1) / align + 1) * align);
+            if (_base > reserved) {
+                munmap(reserved, _base - reserved);
+            }
+            char* reserved_end = reserved + reserve_bytes;
+            char* base_end = _base + _max_arenas * _arena_bytes;
+            if (reserved_end > base_end) {
+                munmap(base_end, reserved_end - base_end);
+            }
 
-            // init instance
-            if (_initializer) {
-                for (pointer p = _start; p != _end; ++p) {
-                    _initializer(p);
+            _arenas = new_aligned<Arena>(_max_arenas);
+            if (!_arenas) {
+                release();
+                return;
+            }
+            for (size_t i = 0; i < _max_arenas; ++i) {
+                _arenas[i].start = _base + i * _arena_bytes;
+            }
+
+            // the first arena is preallocated
+            if (!grow_arena(_arenas[0])) {
+                release();
+                return;
+            }
+
+            // init magazines, all empty
+            if (_magazine_count > 0 && _magazine_size > 0) {
+                _magazine_items = reinterpret_cast<pointer*>(
+                        malloc(_magazine_count * _magazine_size * sizeof(pointer)));
+                _magazines = new_aligned<Magazine>(_magazine_count);
+                if (!_magazine_items || !_magazines) {
+                    free(_magazine_items);
+                    free(_magazines);
+                    _magazine_items = nullptr;
+                    _magazines = nullptr;
+                    return;
+                }
+                for (size_t i = 0; i < _magazine_count; ++i) {
+                    _magazines[i].items = _magazine_items + i * _magazine_size;
                 }
             }
+        }
+    }
 
-            // init slots
-            _slots = new std::atomic<slot_type>[_slot_count];
-            for (slot_index_type i = 0; i < _slot_count - 1; ++i) {
-                _slots[i].store(SLOT_INITIALIZER);
+    // created at the first fetch_shared, most pools never need it
+    ControlBlockPool* control_blocks() {
+        ControlBlockPool* block_pool = _control_blocks.load(std::memory_order_acquire);
+        if (block_pool == nullptr) {
+            InstancePoolOptions options = _options;
+            options.cache_line_aligned = false;
+            ControlBlockPool* new_pool = new ControlBlockPool(options);
+            if (_control_blocks.compare_exchange_strong(block_pool, new_pool)) {
+                block_pool = new_pool;
+            } else {
+                delete new_pool;
             }
-            size_t remain = _capacity - ((_slot_count - 1) * SLOT_CAPACITY);
-            slot_type highest_slot_init = (0x01UL << remain) - 1;
-            _slots[_slot_count - 1].store(highest_slot_init);
         }
+        return block_pool;
     }
 
     void release() {
-        if (_slots) {
-            delete[] _slots;
-            _slots = nullptr;
-        }
-        if (_start) {
-            if (_uninitializer) {
-                for (pointer p = _start; p != _end; ++p) {
-                    _uninitializer(p);
+        if (_control_blocks.load()) {
+            delete _control_blocks.load();
+            _control_blocks.store(nullptr);
+        }
+        // instances in magazines are already deconstructed, just drop them
+        if (_magazines) {
+            free(_magazines);
+            _magazines = nullptr;
+        }
+        if (_magazine_items) {
+            free(_magazine_items);
+            _magazine_items = nullptr;
+        }
+        if (_arenas) {
+            for (size_t i = 0; i < _max_arenas; ++i) {
+                Arena& arena = _arenas[i];
+                if (arena.state.load() == ARENA_ACTIVE && _uninitializer) {
+                    for (size_t index = 0; index < _capacity; ++index) {
+                        _uninitializer(instance_at(arena, index));
+                    }
                 }
+                free(arena.slots);
+                free(arena.summary);
             }
-            free(_start);
-            _start = nullptr;
-            _end = nullptr;
+            free(_arenas);
+            _arenas = nullptr;
+        }
+        if (_base) {
+            munmap(_base, _max_arenas * _arena_bytes);
+            _base = nullptr;
+        }
+    }
+
+    // only one arena grows at a time, others fall back to malloc meanwhile
+    bool grow_arena(Arena& arena) {
+        if (_growing.exchange(true)) {
+            return false;
         }
+        bool grown = false;
+        int expected = ARENA_EMPTY;
+        if (arena.state.compare_exchange_strong(expected, ARENA_GROWING)) {
+            grown = commit_arena(arena);
+            arena.state.store(grown ? ARENA_ACTIVE : ARENA_EMPTY, std::memory_order_release);
+            PRINT_DEBUG("grow arena %ld %s", &arena - _arenas, grown ? "succ" : "fail");
+        }
+        _growing.store(false);
+        return grown;
     }
 
-    pointer fetch_in_slot(slot_index_type slot) {
-        slot_type slot_data = _slots[slot].load();
-        PRINT_DEBUG("trying fetch in slot:%u-%x", slot, slot_data);
+    bool commit_arena(Arena& arena) {
+        // bitmaps are kept after arena released, reused when it grows again
+        if (!arena.slots) {
+            arena.slots = new_aligned<AlignedSlot>(_slot_count);
+        }
+        if (!arena.summary) {
+            arena.summary = new_aligned<AlignedSlot>(_summary_count);
+        }
+        if (!arena.slots || !arena.summary || !map_arena(arena)) {
+            return false;
+        }
+
+        // init instance
+        if (_initializer) {
+            for (size_t index = 0; index < _capacity; ++index) {
+                _initializer(instance_at(arena, index));
+            }
+        }
+
+        // init slots, one bit per instance
+        // and summary, one bit per slot
+        // idle from now on, or else a concurrent release would take it before any use
+        arena.idle_since.store(get_milli());
+        arena.availablity.store(_capacity);
+        fill_slots(arena.slots, _slot_count, _capacity);
+        fill_slots(arena.summary, _summary_count, _slot_count);
+        _availablity += _capacity;
+        return true;
+    }
+
+    bool retire_arena(Arena& arena) {
+        int expected = ARENA_ACTIVE;
+        if (!arena.state.compare_exchange_strong(expected, ARENA_RETIRING)) {
+            return false;
+        }
+
+        // claim all instances, give up if any one is fetched meanwhile
+        size_t claimed = 0;
+        for (; claimed < _slot_count; ++claimed) {
+            slot_type full = slot_full_bits(claimed);
+            if (!arena.slots[claimed].bits.compare_exchange_strong(full, 0)) {
+                break;
+            }
+        }
+        if (claimed < _slot_count) {
+            for (size_t i = 0; i < claimed; ++i) {
+                set_slot_bits(arena, i, slot_full_bits(i));
+            }
+            arena.state.store(ARENA_ACTIVE, std::memory_order_release);
+            return false;
+        }
+        for (size_t i = 0; i < _summary_count; ++i) {
+            arena.summary[i].bits.store(0);
+        }
+        arena.availablity.store(0);
+        _availablity -= _capacity;
+
+        if (_uninitializer) {
+            for (size_t index = 0; index < _capacity; ++index) {
+                _uninitializer(instance_at(arena, index));
+            }
+        }
+        unmap_arena(arena);
+        arena.state.store(ARENA_EMPTY, std::memory_order_release);
+        PRINT_DEBUG("arena %ld released", &arena - _arenas);
+        return true;
+    }
+
+    // commit memory of an arena before first touch, so huge page and numa policy take effect
+    bool map_arena(Arena& arena) {
+        bool mapped = false;
+#ifdef MAP_HUGETLB
+        if (_huge_page) {
+            mapped = (MAP_FAILED != mmap(arena.start, _arena_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0));
+            if (!mapped) {
+                // no huge page reserved in system, restore the range and try transparent huge page
+                PRINT_DEBUG("MAP_HUGETLB failed for arena %ld", &arena - _arenas);
+                unmap_arena(arena);
+            }
+        }
+#endif
+        if (!mapped) {
+            if (0 != mprotect(arena.start, _arena_bytes, PROT_READ | PROT_WRITE)) {
+                return false;
+            }
+#ifdef MADV_HUGEPAGE
+            if (_huge_page) {
+                madvise(arena.start, _arena_bytes, MADV_HUGEPAGE);
+            }
+#endif
+        }
+        if (_numa_node >= 0) {
+            bind_numa_node(arena.start, _arena_bytes, _numa_node);
+        }
+        return true;
+    }
+
+    // give memory back to system, keep the address range reserved
+    void unmap_arena(Arena& arena) {
+        mmap(arena.start, _arena_bytes, PROT_NONE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    }
+
+    pointer instance_at(const Arena& arena, size_t index) const {
+        return reinterpret_cast<pointer>(arena.start + index * _stride);
+    }
+
+    slot_type slot_full_bits(size_t slot) const {
+        return lowest_bits_mask<slot_type>(_capacity - std::min(_capacity, slot * SLOT_CAPACITY));
+    }
+
+    // summary bit is only a hint, the slot word is always checked by CAS
+    void set_summary(Arena& arena, slot_index_type slot) {
+        auto summary_pair = slot_of(slot);
+        arena.summary[summary_pair.first].bits.fetch_or(static_cast<slot_type>(0x01) << summary_pair.second);
+    }
+
+    void set_slot_bits(Arena& arena, slot_index_type slot, slot_type bits) {
+        slot_type old_data = arena.slots[slot].bits.fetch_or(bits);
+        if (old_data == 0) {
+            // slot turns available, mark it in summary
+            set_summary(arena, slot);
+        }
+    }
+
+    void clear_summary(Arena& arena, slot_index_type slot) {
+        auto summary_pair = slot_of(slot);
+        slot_type bit = static_cast<slot_type>(0x01) << summary_pair.second;
+        arena.summary[summary_pair.first].bits.fetch_and(~bit);
+        // instance may be given back between slot exhausted and summary cleared
+        if (arena.slots[slot].bits.load() != 0) {
+            arena.summary[summary_pair.first].bits.fetch_or(bit);
+        }
+    }
+
+    // active arenas are tried in order, so the later ones get idle and released first
+    size_t fetch_from_arenas(pointer* out, size_t max_count, bool fast_fail) {
+        size_t count = 0;
+        bool grown = false;
+        for (size_t i = 0; i < _max_arenas && count < max_count; ++i) {
+            Arena& arena = _arenas[i];
+            int state = arena.state.load(std::memory_order_acquire);
+            if (state == ARENA_EMPTY && !grown && _availablity.load() == 0) {
+                // all arenas run out, add one instead of falling back to malloc
+                grown = grow_arena(arena);
+                state = arena.state.load(std::memory_order_acquire);
+            }
+            if (state == ARENA_ACTIVE) {
+                count += fetch_in_arena(arena, out + count, max_count - count, fast_fail);
+            }
+        }
+        return count;
+    }
+
+    size_t fetch_in_arena(Arena& arena, pointer* out, size_t max_count, bool fast_fail) {
+        if (arena.availablity.load() == 0) {
+            return 0;
+        }
+        // summary words tell which slots have available instances
+        size_t count = 0;
+        size_t summary_tries = fast_fail ? 1 : _summary_count;
+        slot_index_type start_index = (arena.slot_rr++) % _summary_count;
+        for (size_t i = 0; i < summary_tries && count < max_count; ++i) {
+            slot_index_type summary = (start_index + i) % _summary_count;
+            count += fetch_in_summary(arena, summary, out + count, max_count - count);
+        }
+        return count;
+    }
+
+    // fetch at most max_count instances from slots marked in one summary word
+    size_t fetch_in_summary(Arena& arena, slot_index_type summary, pointer* out, size_t max_count) {
+        size_t count = 0;
+        slot_type summary_data = arena.summary[summary].bits.load();
+        while (summary_data != 0 && count < max_count) {
+            slot_index_type index_in_summary = lowest_bit_of(summary_data);
+            slot_index_type slot = index_in_summary + (summary << SLOT_BITS);
+            size_t fetched = fetch_in_slot(arena, slot, out + count, max_count - count);
+            if (fetched == 0) {
+                // slot exhausted by others, skip it
+                clear_summary(arena, slot);
+            }
+            count += fetched;
+            summary_data &= ~(static_cast<slot_type>(0x01) << index_in_summary);
+        }
+        return count;
+    }
+
+    // claim at most max_count instances of one slot by a single CAS
+    size_t fetch_in_slot(Arena& arena, slot_index_type slot, pointer* out, size_t max_count) {
+        slot_type slot_data = arena.slots[slot].bits.load();
+        PRINT_DEBUG("trying fetch in slot:%u-%lx", slot, slot_data);
         while (slot_data != 0) {
-            slot_index_type index_in_slot = lowest_bit_of(slot_data);
-            slot_type mask = ~(0x01UL << index_in_slot);
-            slot_type new_data = (slot_data & mask);
-            PRINT_DEBUG("try set slot %u value %x - %x fetch index %u",
-                    slot, slot_data, new_data, index_in_slot);
-            if (_slots[slot].compare_exchange_strong(slot_data, new_data)) {
-                // found available instance
-                --_availablity;
-                size_t index = index_in_slot + (slot << SLOT_BITS);
-
-                PRINT_DEBUG("fetch instance at %ld in slot[%u-%u] %lx",
-                        index, slot, index_in_slot, new_data);
-                return _start + index;
+            slot_type taken = 0;
+            slot_type rest = slot_data;
+            for (size_t i = 0; i < max_count && rest != 0; ++i) {
+                taken |= (rest & (~rest + 1));
+                rest &= (rest - 1);
+            }
+            slot_type new_data = (slot_data & ~taken);
+            PRINT_DEBUG("try set slot %u value %lx - %lx", slot, slot_data, new_data);
+            if (arena.slots[slot].bits.compare_exchange_strong(slot_data, new_data)) {
+                // found available instances
+                size_t count = 0;
+                while (taken != 0) {
+                    slot_index_type index_in_slot = lowest_bit_of(taken);
+                    size_t index = index_in_slot + (static_cast<size_t>(slot) << SLOT_BITS);
+                    PRINT_DEBUG("fetch instance at %ld in slot[%u-%u] %lx",
+                            index, slot, index_in_slot, new_data);
+                    out[count++] = instance_at(arena, index);
+                    taken &= (taken - 1);
+                }
+                arena.availablity -= count;
+                _availablity -= count;
+                if (new_data == 0) {
+                    clear_summary(arena, slot);
+                }
+                return count;
             } else {
-                PRINT_DEBUG("slot %u value changed %x retry", slot, slot_data);
+                PRINT_DEBUG("slot %u value changed %lx retry", slot, slot_data);
             }
         }
-        return nullptr;
+        return 0;
+    }
+
+    void give_back_to_arena(Arena& arena, slot_index_type slot, slot_type bits, size_t count) {
+        set_slot_bits(arena, slot, bits);
+        _availablity += count;
+        if ((arena.availablity += count) == _capacity && &arena != _arenas) {
+            // added arena gets idle, release it after cool-down
+            arena.idle_since.store(get_milli());
+            release_idle_arenas();
+        } else if (_max_arenas > 1 && (++_idle_check_tick % IDLE_CHECK_INTERVAL) == 0) {
+            // arenas got idle before are released here after cool-down
+            release_idle_arenas();
+        }
+    }
+
+    // magazine of current thread, nullptr if disabled or held by another thread
+    Magazine* lock_magazine() {
+        if (_magazines == nullptr) {
+            return nullptr;
+        }
+        Magazine* magazine = &_magazines[current_thread_index() % _magazine_count];
+        if (magazine->locked.exchange(true, std::memory_order_acquire)) {
+            // never wait, go to the slots instead
+            return nullptr;
+        }
+        return magazine;
+    }
+
+    void unlock_magazine(Magazine* magazine) {
+        magazine->locked.store(false, std::memory_order_release);
+    }
+
+    pointer fetch_from_magazine() {
+        Magazine* magazine = lock_magazine();
+        if (magazine == nullptr) {
+            return nullptr;
+        }
+        if (magazine->size == 0) {
+            // underflow, refill half a magazine from slots
+            size_t batch = std::max(static_cast<size_t>(1), _magazine_size >> 1);
+            magazine->size = fetch_from_arenas(magazine->items, batch, false);
+        }
+        pointer p = magazine->size > 0 ? magazine->items[--magazine->size] : nullptr;
+        unlock_magazine(magazine);
+        return p;
+    }
+
+    bool give_back_to_magazine(pointer p) {
+        Magazine* magazine = lock_magazine();
+        if (magazine == nullptr) {
+            return false;
+        }
+        if (magazine->size == _magazine_size) {
+            // overflow, flush the older half to slots and keep the recent ones
+            size_t flush_count = _magazine_size - (_magazine_size >> 1);
+            give_back_to_slots(magazine->items, flush_count);
+            magazine->size -= flush_count;
+            memmove(magazine->items, magazine->items + flush_count, magazine->size * sizeof(pointer));
+        }
+        magazine->items[magazine->size++] = p;
+        unlock_magazine(magazine);
+        return true;
+    }
+
+    // give back instances in pool, one fetch_or per slot
+    void give_back_to_slots(pointer* items, size_t count) {
+        std::sort(items, items + count);
+        size_t i = 0;
+        while (i < count) {
+            Arena* arena = nullptr;
+            size_t index = 0;
+            locate(items[i], &arena, &index);
+            slot_index_type slot = slot_of(index).first;
+            slot_type bits = 0;
+            size_t bits_count = 0;
+            for (; i < count; ++i, ++bits_count) {
+                Arena* item_arena = nullptr;
+                size_t item_index = 0;
+                locate(items[i], &item_arena, &item_index);
+                auto slot_pair = slot_of(item_index);
+                if (item_arena != arena || slot_pair.first != slot) {
+                    break;
+                }
+                bits |= (static_cast<slot_type>(0x01) << slot_pair.second);
+            }
+            give_back_to_arena(*arena, slot, bits, bits_count);
+        }
     }
 
 private:
+    // instances per arena
     const size_t _capacity;
     const size_t _slot_count;
-    pointer _start;
-    pointer _end;
+    const size_t _summary_count;
+    const size_t _max_arenas;
+    const int64_t _arena_idle_ms;
+    const size_t _magazine_size;
+    const size_t _magazine_count;
+    const size_t _stride;
+    const bool _huge_page;
+    const int _numa_node;
+
+    // reserved address range of all arenas
+    size_t _arena_bytes;
+    char* _base;
+    Arena* _arenas;
 
-    // round robin between slots
+    // available instances of all arenas
     std::atomic<size_t> _availablity;
-    std::atomic<slot_index_type> _slot_rr;
-    std::atomic<slot_type>* _slots;
+    std::atomic<bool> _growing;
+    std::atomic<size_t> _idle_check_tick;
+
+    // per thread caches, indexed by thread index
+    Magazine* _magazines;
+    pointer* _magazine_items;
+
+    // shared_ptr control blocks
+    std::atomic<ControlBlockPool*> _control_blocks;
+    const InstancePoolOptions _options;
 
     // һ뵽ڴʱĳʼͷڴǰķʼ
     // ĬΪnullptr, ʲôҲ
@@ -443,6 +1054,23 @@ private:
     deconstruct_type _deconstructor;
 };
  
+template<typename U>
+U* ControlBlockAllocator<U>::allocate(size_t n) {
+    static_assert(sizeof(U) <= sizeof(ControlBlock) && alignof(U) <= alignof(ControlBlock),
+            "control block of shared_ptr is larger than ControlBlock");
+    U* p = n == 1 ? reinterpret_cast<U*>(pool->fetch()) : nullptr;
+    if (p == nullptr) {
+        // shared_ptr never checks the result
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+template<typename U>
+void ControlBlockAllocator<U>::deallocate(U* p, size_t /*n*/) {
+    pool->give_back(reinterpret_cast<ControlBlock*>(p));
+}
+
 } // end namespace common
  
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
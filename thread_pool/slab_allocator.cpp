@@ -0,0 +1,92 @@
+/**
+ * @file slab_allocator.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-03-20 15:42:08
+ * @brief
+ *
+ **/
+
+#include "thread_pool/slab_allocator.h"
+
+#include <algorithm>
+
+#include "thread_pool/instance_pool.h"
+
+namespace common {
+
+// each arena of a class holds about this much memory
+static const size_t kSlabArenaBytes = 1024 * 1024;
+static const size_t kSlabMinArenaCapacity = 64;
+static const size_t kSlabMaxArenas = 64;
+// blocks cached per thread magazine
+static const size_t kSlabMagazineSize = 32;
+
+template<size_t BlockSize>
+struct SlabBlock {
+    alignas(16) char data[BlockSize];
+};
+
+template<size_t BlockSize>
+class SlabClassImpl : public SlabClass {
+public:
+    SlabClassImpl() : _pool(pool_options()) {}
+    virtual ~SlabClassImpl() {}
+
+    virtual void* allocate() {
+        return _pool.fetch();
+    }
+
+    virtual void deallocate(void* p) {
+        _pool.give_back(static_cast<SlabBlock<BlockSize>*>(p));
+    }
+
+private:
+    static InstancePoolOptions pool_options() {
+        InstancePoolOptions options(std::max(kSlabMinArenaCapacity, kSlabArenaBytes / BlockSize));
+        options.max_arenas = kSlabMaxArenas;
+        options.magazine_size = kSlabMagazineSize;
+        return options;
+    }
+
+    InstancePool<SlabBlock<BlockSize> > _pool;
+};
+
+// create class Index and all below
+template<size_t Index>
+struct SlabClassMaker {
+    static void make(SlabClass** classes) {
+        SlabClassMaker<Index - 1>::make(classes);
+        static const size_t BLOCK_SIZE = (Index & 0x01) == 0 ?
+                (SlabAllocator::MIN_SLAB_SIZE << (Index >> 1)) : (24UL << (Index >> 1));
+        classes[Index] = new SlabClassImpl<BLOCK_SIZE>();
+    }
+};
+
+template<>
+struct SlabClassMaker<0> {
+    static void make(SlabClass** classes) {
+        classes[0] = new SlabClassImpl<SlabAllocator::MIN_SLAB_SIZE>();
+    }
+};
+
+SlabAllocator& SlabAllocator::instance() {
+    // never destroyed, buffers may be freed by other static objects at exit
+    static SlabAllocator* s_instance = new SlabAllocator();
+    return *s_instance;
+}
+
+SlabAllocator::SlabAllocator() {
+    static_assert((MAX_SLAB_SIZE >> 4) == (1UL << ((SLAB_CLASS_COUNT - 1) >> 1)),
+            "SLAB_CLASS_COUNT does not match MAX_SLAB_SIZE");
+    SlabClassMaker<SLAB_CLASS_COUNT - 1>::make(_classes);
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (size_t i = 0; i < SLAB_CLASS_COUNT; ++i) {
+        delete _classes[i];
+    }
+}
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
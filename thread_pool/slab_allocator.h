@@ -0,0 +1,187 @@
+/**
+ * @file slab_allocator.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-03-20 15:42:08
+ * @brief 按size class分级的slab内存分配器, 每级由一个带线程缓存的InstancePool承载
+ *
+ **/
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace common {
+
+// one size class, implemented by an InstancePool of fixed size blocks
+class SlabClass {
+public:
+    virtual ~SlabClass() {}
+    virtual void* allocate() = 0;
+    virtual void deallocate(void* p) = 0;
+};
+
+class SlabAllocator {
+public:
+    // size classes are 16, 24, 32, 48, 64, 96 ... up to MAX_SLAB_SIZE,
+    // larger memory goes to malloc
+    static const size_t MIN_SLAB_SIZE = 16;
+    static const size_t MAX_SLAB_SIZE = 64 * 1024;
+    static const size_t SLAB_CLASS_COUNT = 25;
+
+    static SlabAllocator& instance();
+
+    // size of deallocate must be the one passed to allocate
+    void* allocate(size_t size) {
+        if (size > MAX_SLAB_SIZE) {
+            return malloc(size);
+        }
+        return _classes[class_of(size)]->allocate();
+    }
+
+    void deallocate(void* p, size_t size) {
+        if (p == nullptr) {
+            return;
+        }
+        if (size > MAX_SLAB_SIZE) {
+            free(p);
+            return;
+        }
+        _classes[class_of(size)]->deallocate(p);
+    }
+
+    // memory actually held for size, callers may use all of it
+    static size_t block_size_of(size_t size) {
+        return size > MAX_SLAB_SIZE ? size : class_size(class_of(size));
+    }
+
+    static size_t class_size(size_t index) {
+        return (index & 0x01) == 0 ? (MIN_SLAB_SIZE << (index >> 1)) : (24UL << (index >> 1));
+    }
+
+    static size_t class_of(size_t size) {
+        if (size <= MIN_SLAB_SIZE) {
+            return 0;
+        }
+        // 2^bits < size <= 2^(bits+1)
+        size_t bits = 63 - __builtin_clzll(static_cast<unsigned long long>(size - 1));
+        size_t index = (bits - 4) << 1;
+        return size <= (3UL << (bits - 1)) ? index + 1 : index + 2;
+    }
+
+private:
+    SlabAllocator();
+    ~SlabAllocator();
+
+    // disallow copy
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator = (const SlabAllocator&) = delete;
+
+    SlabClass* _classes[SLAB_CLASS_COUNT];
+};
+
+inline void* slab_allocate(size_t size) {
+    return SlabAllocator::instance().allocate(size);
+}
+
+inline void slab_deallocate(void* p, size_t size) {
+    SlabAllocator::instance().deallocate(p, size);
+}
+
+// stl allocator, e.g. std::vector<char, SlabStlAllocator<char> >
+template<typename T>
+class SlabStlAllocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<typename U>
+    struct rebind {
+        typedef SlabStlAllocator<U> other;
+    };
+
+    SlabStlAllocator() {}
+    template<typename U>
+    SlabStlAllocator(const SlabStlAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* p = slab_allocate(n * sizeof(T));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n) {
+        slab_deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator == (const SlabStlAllocator<U>&) const {
+        return true;
+    }
+    template<typename U>
+    bool operator != (const SlabStlAllocator<U>&) const {
+        return false;
+    }
+};
+
+// move only char buffer from slab, replacement of std::unique_ptr<char[]>
+class SlabBuffer {
+public:
+    SlabBuffer() : _data(nullptr), _size(0) {}
+    explicit SlabBuffer(size_t size)
+        : _data(size == 0 ? nullptr : static_cast<char*>(slab_allocate(size))),
+          _size(_data == nullptr ? 0 : size) {}
+    ~SlabBuffer() {
+        reset();
+    }
+
+    SlabBuffer(SlabBuffer&& other) : _data(other._data), _size(other._size) {
+        other._data = nullptr;
+        other._size = 0;
+    }
+    SlabBuffer& operator = (SlabBuffer&& other) {
+        if (this != &other) {
+            reset();
+            std::swap(_data, other._data);
+            std::swap(_size, other._size);
+        }
+        return *this;
+    }
+
+    void reset() {
+        if (_data) {
+            slab_deallocate(_data, _size);
+            _data = nullptr;
+            _size = 0;
+        }
+    }
+
+    char* get() { return _data; }
+    const char* get() const { return _data; }
+    size_t size() const { return _size; }
+
+    char& operator[] (size_t index) { return _data[index]; }
+    const char& operator[] (size_t index) const { return _data[index]; }
+
+    explicit operator bool() const { return _data != nullptr; }
+
+private:
+    // disallow copy
+    SlabBuffer(const SlabBuffer&) = delete;
+    SlabBuffer& operator = (const SlabBuffer&) = delete;
+
+    char* _data;
+    size_t _size;
+};
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
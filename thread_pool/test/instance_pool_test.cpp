@@ -9,20 +9,28 @@
 //#define __DEBUG_INSTANCE_POOL__
 #define __FAST_FAIL__
 
+#include <assert.h>
 #include <functional>
 #include <iostream>
 #include <mutex>
- 
+#include <set>
+#include <vector>
+
 #include "thread_pool/atomic_array_queue.h"
 #include "thread_pool/instance_pool.h"
 #include "thread_pool/timer.h"
- 
+
 using namespace common;
 
 static const size_t kInstancePoolCapacity = 32;
 static const size_t kInstanceCount = 1003;
 static const size_t kQueueLen = 64;
 static const size_t kObjectSize = 128;
+static const size_t kMagazineSize = 4;
+static const size_t kMaxArenas = 4;
+static const int64_t kArenaIdleMs = 20;
+// more than give_backs between two checks of idle arenas
+static const size_t kIdleCheckRounds = 4096;
 
 static const size_t kFetchThreadNum = 5;
 static const size_t kGivebackThreadNum = 2;
@@ -34,12 +42,37 @@ struct TestStruct {
 typedef AtomicArrayQueue<TestStruct> ObjectQueue;
 typedef InstancePool<TestStruct> ObjectInstancePool;
 
-ObjectInstancePool g_pool(kInstancePoolCapacity);
+static InstancePoolOptions pool_options(size_t magazine_size, size_t max_arenas) {
+    InstancePoolOptions options(kInstancePoolCapacity);
+    options.magazine_size = magazine_size;
+    options.max_arenas = max_arenas;
+    options.arena_idle_ms = kArenaIdleMs;
+    return options;
+}
+
 ObjectQueue g_queue(kQueueLen);
 
 std::mutex g_print_mutex;
 
-static void fetch_thread_func(size_t index) {
+// instances handed out and not given back yet, no instance can be handed out twice
+std::set<TestStruct*> g_fetched;
+std::mutex g_fetched_mutex;
+
+static void mark_fetched(TestStruct* inst) {
+    std::lock_guard<std::mutex> lock(g_fetched_mutex);
+    bool inserted = g_fetched.insert(inst).second;
+    assert(inserted);
+    (void)inserted;
+}
+
+static void mark_given_back(TestStruct* inst) {
+    std::lock_guard<std::mutex> lock(g_fetched_mutex);
+    size_t erased = g_fetched.erase(inst);
+    assert(erased == 1);
+    (void)erased;
+}
+
+static void fetch_thread_func(ObjectInstancePool* pool, size_t index) {
     size_t inst_cnt = kInstanceCount / kFetchThreadNum;
     size_t mod = kInstanceCount % kFetchThreadNum;
     if (index < mod) {
@@ -47,18 +80,19 @@ static void fetch_thread_func(size_t index) {
     }
     for (size_t i = 0; i < inst_cnt; ++i) {
 #ifdef __FAST_FAIL__
-        TestStruct *inst = g_pool.fetch_fast_fail();
+        TestStruct *inst = pool->fetch_fast_fail();
 #else
-        TestStruct *inst = g_pool.fetch();
+        TestStruct *inst = pool->fetch();
 #endif
+        mark_fetched(inst);
         g_queue.push(inst);
     }
 
     std::lock_guard<std::mutex> lock(g_print_mutex);
     std::cout << "Fetch thread: " << index << ", count: " << inst_cnt << std::endl;
 }
- 
-static void giveback_thread_func(size_t index) {
+
+static void giveback_thread_func(ObjectInstancePool* pool, size_t index) {
     size_t inst_cnt = kInstanceCount / kGivebackThreadNum;
     size_t mod = kInstanceCount % kGivebackThreadNum;
     if (index < mod) {
@@ -66,26 +100,28 @@ static void giveback_thread_func(size_t index) {
     }
     for (size_t i = 0; i < inst_cnt; ++i) {
         TestStruct *inst = g_queue.pop();
-        g_pool.give_back(inst);
+        mark_given_back(inst);
+        pool->give_back(inst);
     }
 
     std::lock_guard<std::mutex> lock(g_print_mutex);
     std::cout << "Giveback thread: " << index << ", count: " << inst_cnt << std::endl;
 }
- 
-int main(int argc, char** argv) {
+
+static void test_fetch_and_giveback(const char* name, const InstancePoolOptions& options) {
+    ObjectInstancePool pool(options);
     std::thread* fetch_threads = new std::thread[kFetchThreadNum];
     std::thread* giveback_threads = new std::thread[kGivebackThreadNum];
 
     MicrosecondsTimer timer;
     for (size_t i = 0; i < kFetchThreadNum; ++i) {
-        std::thread t(std::bind(&fetch_thread_func, i));
+        std::thread t(std::bind(&fetch_thread_func, &pool, i));
         fetch_threads[i].swap(t);
     }
 
     std::this_thread::sleep_for(Milliseconds(1));
     for (size_t i = 0; i < kGivebackThreadNum; ++i) {
-        std::thread t(std::bind(&giveback_thread_func, i));
+        std::thread t(std::bind(&giveback_thread_func, &pool, i));
         giveback_threads[i].swap(t);
     }
 
@@ -95,12 +131,96 @@ int main(int argc, char** argv) {
     for (size_t i = 0; i < kGivebackThreadNum; ++i) {
         giveback_threads[i].join();
     }
-    std::cout << "Fetch count: " << kInstanceCount << ", Cost: " << timer.tick() << "us" << std::endl;
+    std::cout << name << " fetch count: " << kInstanceCount << ", Cost: " << timer.tick() << "us" << std::endl;
 
     delete[] fetch_threads;
     delete[] giveback_threads;
+
+    // everything is given back, cached instances included
+    assert(g_fetched.empty());
+    pool.flush_magazines();
+    size_t availablity = pool.availablity();
+    assert(availablity == pool.capacity() * pool.arena_count());
+    (void)availablity;
+}
+
+static void fetch_all(ObjectInstancePool* pool, std::vector<TestStruct*>* insts) {
+    for (size_t i = 0; i < kInstancePoolCapacity * kMaxArenas; ++i) {
+        TestStruct* inst = pool->fetch();
+        assert(inst != nullptr);
+        insts->push_back(inst);
+    }
+    // grown up to max_arenas, and no more
+    size_t arena_count = pool->arena_count();
+    assert(arena_count == kMaxArenas);
+    size_t availablity = pool->availablity();
+    assert(availablity == 0);
+    TestStruct* inst = pool->try_fetch();
+    assert(inst == nullptr);
+    (void)arena_count;
+    (void)availablity;
+    (void)inst;
+}
+
+static void give_back_all(ObjectInstancePool* pool, std::vector<TestStruct*>* insts) {
+    for (size_t i = 0; i < insts->size(); ++i) {
+        pool->give_back((*insts)[i]);
+    }
+    insts->clear();
+}
+
+static void test_arenas() {
+    ObjectInstancePool pool(pool_options(0, kMaxArenas));
+    std::vector<TestStruct*> insts;
+    size_t arena_count = pool.arena_count();
+    assert(arena_count == 1);
+
+    // beyond the ceiling fetch and fetch_fast_fail fall back to malloc
+    fetch_all(&pool, &insts);
+    TestStruct* extra = pool.fetch();
+    assert(extra != nullptr);
+    pool.give_back(extra);
+    extra = pool.fetch_fast_fail();
+    assert(extra != nullptr);
+    pool.give_back(extra);
+
+    // released by the owner after cool-down
+    give_back_all(&pool, &insts);
+    size_t released = pool.release_idle_arenas();
+    assert(released == 0);
+    std::this_thread::sleep_for(Milliseconds(kArenaIdleMs * 2));
+    released = pool.release_idle_arenas();
+    assert(released == kMaxArenas - 1);
+    arena_count = pool.arena_count();
+    assert(arena_count == 1);
+    size_t availablity = pool.availablity();
+    assert(availablity == kInstancePoolCapacity);
+
+    // released by later give_backs after cool-down
+    fetch_all(&pool, &insts);
+    give_back_all(&pool, &insts);
+    std::this_thread::sleep_for(Milliseconds(kArenaIdleMs * 2));
+    for (size_t i = 0; i < kIdleCheckRounds; ++i) {
+        pool.give_back(pool.fetch());
+    }
+    arena_count = pool.arena_count();
+    assert(arena_count == 1);
+    availablity = pool.availablity();
+    assert(availablity == kInstancePoolCapacity);
+
+    (void)arena_count;
+    (void)released;
+    (void)availablity;
+    std::cout << "Arenas grow and release ok" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    test_fetch_and_giveback("Default", pool_options(0, 1));
+    test_fetch_and_giveback("Magazine", pool_options(kMagazineSize, 1));
+    test_fetch_and_giveback("Arenas", pool_options(0, kMaxArenas));
+    test_fetch_and_giveback("Magazine arenas", pool_options(kMagazineSize, kMaxArenas));
+    test_arenas();
     return 0;
 }
- 
-/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
 
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,229 @@
+/**
+ * @file slab_allocator_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2026-10-18 18:12:40
+ * @brief slab allocator测试, size class映射, 各级及超大内存的分配释放, stl allocator和SlabBuffer
+ *
+ **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "thread_pool/slab_allocator.h"
+
+using namespace common;
+
+static const size_t kThreadNum = 4;
+static const size_t kRounds = 20000;
+static const size_t kLiveBlocks = 64;
+
+// checked in release builds as well, report and fail the current case
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+static void fill(void* p, size_t size, unsigned char seed) {
+    unsigned char* bytes = static_cast<unsigned char*>(p);
+    for (size_t i = 0; i < size; ++i) {
+        bytes[i] = static_cast<unsigned char>(seed + i);
+    }
+}
+
+static bool filled(const void* p, size_t size, unsigned char seed) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(p);
+    for (size_t i = 0; i < size; ++i) {
+        if (bytes[i] != static_cast<unsigned char>(seed + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool test_size_classes() {
+    CHECK(SlabAllocator::class_size(0) == SlabAllocator::MIN_SLAB_SIZE);
+    CHECK(SlabAllocator::class_size(SlabAllocator::SLAB_CLASS_COUNT - 1)
+            == SlabAllocator::MAX_SLAB_SIZE);
+    for (size_t i = 1; i < SlabAllocator::SLAB_CLASS_COUNT; ++i) {
+        CHECK(SlabAllocator::class_size(i - 1) < SlabAllocator::class_size(i));
+    }
+
+    // every size maps to the smallest class holding it
+    CHECK(SlabAllocator::class_of(0) == 0);
+    for (size_t size = 1; size <= SlabAllocator::MAX_SLAB_SIZE; ++size) {
+        size_t index = SlabAllocator::class_of(size);
+        CHECK(index < SlabAllocator::SLAB_CLASS_COUNT);
+        CHECK(SlabAllocator::class_size(index) >= size);
+        CHECK(index == 0 || SlabAllocator::class_size(index - 1) < size);
+        CHECK(SlabAllocator::block_size_of(size) == SlabAllocator::class_size(index));
+    }
+
+    // class boundaries
+    for (size_t i = 0; i < SlabAllocator::SLAB_CLASS_COUNT; ++i) {
+        size_t size = SlabAllocator::class_size(i);
+        CHECK(SlabAllocator::class_of(size) == i);
+        if (i + 1 < SlabAllocator::SLAB_CLASS_COUNT) {
+            CHECK(SlabAllocator::class_of(size + 1) == i + 1);
+        }
+    }
+
+    // larger memory is not rounded
+    CHECK(SlabAllocator::block_size_of(SlabAllocator::MAX_SLAB_SIZE + 1)
+            == SlabAllocator::MAX_SLAB_SIZE + 1);
+    fprintf(stdout, "size classes ok\n");
+    return true;
+}
+
+static bool round_trip(size_t size) {
+    size_t block_size = SlabAllocator::block_size_of(size);
+    void* first = slab_allocate(size);
+    void* second = slab_allocate(size);
+    CHECK(first != nullptr && second != nullptr && first != second);
+    if (size <= SlabAllocator::MAX_SLAB_SIZE) {
+        CHECK(reinterpret_cast<uintptr_t>(first) % 16 == 0);
+        CHECK(reinterpret_cast<uintptr_t>(second) % 16 == 0);
+    }
+    // the whole block is usable and blocks never overlap
+    fill(first, block_size, 1);
+    fill(second, block_size, 2);
+    CHECK(filled(first, block_size, 1));
+    CHECK(filled(second, block_size, 2));
+    slab_deallocate(first, size);
+    slab_deallocate(second, size);
+    return true;
+}
+
+static bool test_allocate() {
+    for (size_t i = 0; i < SlabAllocator::SLAB_CLASS_COUNT; ++i) {
+        size_t size = SlabAllocator::class_size(i);
+        CHECK(round_trip(size - 1));
+        CHECK(round_trip(size));
+        CHECK(round_trip(size + 1));
+    }
+    // oversize falls back to malloc
+    CHECK(round_trip(SlabAllocator::MAX_SLAB_SIZE * 4));
+    slab_deallocate(nullptr, 16);
+    fprintf(stdout, "allocate ok\n");
+    return true;
+}
+
+static bool test_stl_allocator() {
+    // grows through all classes and beyond
+    std::vector<uint32_t, SlabStlAllocator<uint32_t> > vec;
+    for (uint32_t i = 0; i < 100000; ++i) {
+        vec.push_back(i);
+    }
+    for (uint32_t i = 0; i < vec.size(); ++i) {
+        CHECK(vec[i] == i);
+    }
+    vec.clear();
+    vec.shrink_to_fit();
+
+    // rebound to map nodes
+    typedef std::pair<const int, int> Value;
+    std::map<int, int, std::less<int>, SlabStlAllocator<Value> > map;
+    for (int i = 0; i < 1000; ++i) {
+        map[i] = i * 2;
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        map.erase(i);
+    }
+    CHECK(map.size() == 500);
+    for (const Value& value : map) {
+        CHECK(value.first % 2 == 1 && value.second == value.first * 2);
+    }
+
+    CHECK(SlabStlAllocator<int>() == SlabStlAllocator<char>());
+    CHECK(!(SlabStlAllocator<int>() != SlabStlAllocator<char>()));
+    fprintf(stdout, "stl allocator ok\n");
+    return true;
+}
+
+static bool test_slab_buffer() {
+    SlabBuffer empty(0);
+    CHECK(!empty && empty.get() == nullptr && empty.size() == 0);
+
+    SlabBuffer buffer(100);
+    CHECK(buffer && buffer.size() == 100);
+    fill(buffer.get(), buffer.size(), 3);
+
+    SlabBuffer moved(std::move(buffer));
+    CHECK(!buffer && buffer.size() == 0);
+    CHECK(moved.size() == 100 && filled(moved.get(), moved.size(), 3));
+
+    SlabBuffer large(SlabAllocator::MAX_SLAB_SIZE + 1);
+    fill(large.get(), large.size(), 4);
+    // the old memory of large is given back
+    large = std::move(moved);
+    CHECK(!moved);
+    CHECK(large.size() == 100 && filled(large.get(), large.size(), 3));
+    large.reset();
+    CHECK(!large && large.size() == 0);
+    fprintf(stdout, "slab buffer ok\n");
+    return true;
+}
+
+// blocks of random classes allocated and freed by several threads, none is handed out twice
+static void stress_thread_func(size_t index, bool* result) {
+    std::minstd_rand rand(index + 1);
+    std::vector<std::pair<void*, size_t> > live;
+    *result = false;
+    for (size_t i = 0; i < kRounds; ++i) {
+        if (live.size() < kLiveBlocks && rand() % 2 == 0) {
+            size_t size = 1 + rand() % (SlabAllocator::MAX_SLAB_SIZE / 16);
+            void* p = slab_allocate(size);
+            if (p == nullptr) {
+                return;
+            }
+            fill(p, size, static_cast<unsigned char>(index));
+            live.push_back(std::make_pair(p, size));
+        } else if (!live.empty()) {
+            std::pair<void*, size_t> block = live.back();
+            live.pop_back();
+            if (!filled(block.first, block.second, static_cast<unsigned char>(index))) {
+                return;
+            }
+            slab_deallocate(block.first, block.second);
+        }
+    }
+    for (size_t i = 0; i < live.size(); ++i) {
+        slab_deallocate(live[i].first, live[i].second);
+    }
+    *result = true;
+}
+
+static bool test_threads() {
+    bool results[kThreadNum];
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kThreadNum; ++i) {
+        threads.emplace_back(stress_thread_func, i, &results[i]);
+    }
+    for (size_t i = 0; i < kThreadNum; ++i) {
+        threads[i].join();
+    }
+    for (size_t i = 0; i < kThreadNum; ++i) {
+        CHECK(results[i]);
+    }
+    fprintf(stdout, "threads ok\n");
+    return true;
+}
+
+int main() {
+    bool ok = test_size_classes();
+    ok = test_allocate() && ok;
+    ok = test_stl_allocator() && ok;
+    ok = test_slab_buffer() && ok;
+    ok = test_threads() && ok;
+    return ok ? 0 : 1;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
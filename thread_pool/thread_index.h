@@ -0,0 +1,25 @@
+/**
+ * @file thread_index.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-03-12 10:21:37
+ * @brief 线程序号, 用于把线程分散到per-thread的缓存/计数上
+ *
+ **/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace common {
+
+// sequential index of current thread, assigned at the first call in each thread
+// indexes are never reused, use it modulo a fixed count
+inline size_t current_thread_index() {
+    static std::atomic<size_t> s_thread_count(0);
+    static thread_local size_t t_thread_index = s_thread_count.fetch_add(1);
+    return t_thread_index;
+}
+
+} // end namespace common
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
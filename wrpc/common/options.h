@@ -9,8 +9,12 @@
 #ifndef WRPC_COMMON_OPTIONS_H_
 #define WRPC_COMMON_OPTIONS_H_
  
+#include <functional>
 #include <stdint.h>
 #include <string>
+#include <vector>
+
+#include "utils/common_flags.h"
  
 namespace wrpc {
 
@@ -19,18 +23,42 @@ enum ConnectionType {
     POOLED,
 };
 
+// how connections of a channel do blocking connect, send and receive
+enum IOBackend {
+    // poll then read/write
+    IO_BACKEND_POLL = 0,
+    // io_uring, falls back to poll if not supported by kernel
+    IO_BACKEND_IO_URING,
+};
+
+// runs a user callback, e.g. by pushing it to a thread pool
+// every task handed to the executor must be run exactly once, either later in another
+// thread or inline, the controller is not locked while the executor is called
+typedef std::function<void (const std::function<void ()>&)> CallbackExecutor;
+
 // options for rpc one times
 struct RPCOptions {
     int32_t total_timeout_ms;
     int32_t connect_timeout_ms;
     int32_t backup_request_timeout_ms;
     uint32_t max_retry_num;
+    // read and parse response, then finish the rpc directly in the event dispatcher
+    // thread instead of the background thread, saving a queue hop per response.
+    // ignored for protocols whose response parser may block (no support_consume).
+    // retries and backup requests connect and send blocking, they are still issued
+    // outside the event dispatcher thread
+    bool run_in_dispatcher;
+    // user callback is handed to this executor if set, otherwise it runs in the
+    // thread finishing the rpc
+    CallbackExecutor callback_executor;
 
     RPCOptions()
         : total_timeout_ms(-1),
           connect_timeout_ms(-1),
           backup_request_timeout_ms(-1),
-          max_retry_num(0) {}
+          max_retry_num(0),
+          run_in_dispatcher(false),
+          callback_executor(nullptr) {}
 };
 
 struct ChannelOptions : public RPCOptions {
@@ -38,6 +66,10 @@ struct ChannelOptions : public RPCOptions {
     std::string load_balancer;
     std::string retry_policy;
     ConnectionType connection_type;
+    IOBackend io_backend;
+    // SO_BUSY_POLL on sockets in microseconds, 0 for disabled
+    // needs CAP_NET_ADMIN to exceed net.core.busy_read
+    uint32_t socket_busy_poll_us;
     size_t max_connection_per_endpoint; // used for connection pool
     int32_t  max_error_count_per_endpoint;
 
@@ -49,6 +81,8 @@ struct ChannelOptions : public RPCOptions {
           load_balancer("rr"),
           retry_policy(""),
           connection_type(SHORT),
+          io_backend(IO_BACKEND_POLL),
+          socket_busy_poll_us(0),
           max_connection_per_endpoint(1),
           max_error_count_per_endpoint(-1),
           update_end_points_interval(5000),
@@ -56,6 +90,24 @@ struct ChannelOptions : public RPCOptions {
 
     const RPCOptions& default_rpc_options() const { return *this; }
 };
+
+// options of the global event dispatchers, see init_event_dispatchers
+struct EventDispatcherOptions {
+    // number of reactor threads
+    uint32_t dispatcher_num;
+    // max events fetched by one epoll_wait
+    uint32_t event_size;
+    // dispatcher i is pinned to cpu_affinity[i % size], not pinned if empty
+    std::vector<int> cpu_affinity;
+    // spin with non-blocking epoll_wait for this long before blocking, 0 for disabled
+    // burns a core per dispatcher, use with dedicated cpu_affinity
+    uint32_t busy_poll_us;
+
+    EventDispatcherOptions()
+        : dispatcher_num(WRPC_EVENT_DISPATCHER_NUMS),
+          event_size(WRPC_EVENT_DISPATCHER_EVENT_SIZE),
+          busy_poll_us(0) {}
+};
  
 } // end namespace wrpc
  
@@ -16,16 +16,23 @@
 #include "common/end_point.h"
 #include "common/rpc_feedback.h"
 #include "interface/end_point_watcher.h"
+#include "utils/arena.h"
 #include "utils/factory.h"
  
 namespace wrpc {
 
+typedef std::vector<EndPoint, ArenaAllocator<EndPoint> > TryList;
+
 struct LoadBalancerContext {
+    // try list allocated from arena if given
+    explicit LoadBalancerContext(Arena* arena = nullptr)
+        : retry_count(0), hash_code(0), try_list(ArenaAllocator<EndPoint>(arena)), data(0) {}
+
     std::string logid;
     uint32_t retry_count;
     size_t hash_code;
     // history try list
-    std::vector<EndPoint> try_list;
+    TryList try_list;
     // store session data for lb strategy
     uint64_t data;
 };
@@ -36,12 +36,44 @@ typedef StrategyCreator<IRequest> RequestCreator;
 typedef StrategyDeleter<IRequest> RequestDeleter;
 typedef StrategyFactory<IRequest> RequestFactory;
 
+// Ľ
+enum ParseResult {
+    PARSE_ERROR = -1,
+    PARSE_NEED_MORE = 0,
+    PARSE_DONE = 1,
+};
+
 class IResponse {
 public:
     IResponse() {}
     virtual ~IResponse() {}
 
+    // ȡһӦ
     virtual int read_from(Readable* readable, int32_t timeout) = 0;
+
+    // Ƿ֧, ֧ʱݵɿܶӵĶ岢consume, 
+    virtual bool support_consume() const { return false; }
+
+    // µӦǰ, ѽݺͽ״̬
+    virtual void reset() {}
+
+    /**
+     * @brief յ
+     *
+     * @param [in] buf : const char*
+     * @param [in] len : size_t
+     * @param [out] consumed : size_t*
+     *        ʹõֽ, δʹõ(粻һ)֮յһٴδ
+     *
+     * @return ParseResult
+     *        PARSE_NEED_MORE: Ӧ, Ҫ
+     *        PARSE_DONE: һӦ
+     *        PARSE_ERROR: ʧ
+     */
+    virtual ParseResult consume(const char* /*buf*/, size_t /*len*/, size_t* consumed) {
+        *consumed = 0;
+        return PARSE_ERROR;
+    }
 };
 
 typedef StrategyCreator<IResponse> ResponseCreator;
@@ -9,6 +9,8 @@
 #include "message/http_message.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 
 #include "utils/common_define.h"
 #include "utils/timer.h"
@@ -149,7 +151,10 @@ void HttpRequest::append_body(const char* buf, size_t len) {
 HttpResponse::HttpResponse()
     : _code(200),
       _version(DEFAULT_HTTP_VERSION),
-      _is_chunked(false) {
+      _is_chunked(false),
+      _parse_state(STATUS_LINE),
+      _body_len(0),
+      _data_read(0) {
     _body.push_back('\0');
 }
 
@@ -165,6 +170,17 @@ bool HttpResponse::has_header(const std::string& key) const {
     return _headers.find(key) != _headers.end();
 }
 
+void HttpResponse::reset() {
+    _headers.clear();
+    _body.clear();
+    _body.push_back('\0');
+    _chunks.clear();
+    _is_chunked = false;
+    _parse_state = STATUS_LINE;
+    _body_len = 0;
+    _data_read = 0;
+}
+
 int HttpResponse::read_from(Readable* readable, int32_t timeout) {
     if (readable == nullptr) {
         return NET_INVALID_ARGUMENT;
@@ -173,12 +189,7 @@ int HttpResponse::read_from(Readable* readable, int32_t timeout) {
     MillisecondsCountdownTimer timer(timeout);
     MillisecondsCountdownTimer::rep_type remain = timeout;
 
-    // reset
-    _headers.clear();
-    _body.clear();
-    _body.push_back('\0');
-    _chunks.clear();
-    _is_chunked = false;
+    reset();
     
     ssize_t ret = readable->read_line(_header_buf, sizeof(_header_buf) - 1, remain);
     if (ret < 0) {
@@ -186,16 +197,11 @@ int HttpResponse::read_from(Readable* readable, int32_t timeout) {
     }
     _header_buf[ret] = '\0';
     
-    int err = sscanf(_header_buf, "HTTP/%u.%u %u %511s\r\n",
-            &(_version.first), &(_version.second), &_code, _ext_buf);
-    if (err != 4) {
-        WARNING("parse http repsponse status line [%s] failed.", _header_buf);
-        return NET_MESSAGE_NOT_MATCH;
+    int err = parse_status_line();
+    if (err != NET_SUCC) {
+        return err;
     }
     
-    _reason = _ext_buf;
-    DEBUG("http response status line: [HTTP/%u.%u %03u %s]", _version.first, _version.second, _code, _reason.c_str());
-    
     if (timer.timeout(&remain)) {
         return NET_TIMEOUT;
     }
@@ -229,26 +235,7 @@ int HttpResponse::read_header(Readable* readable, int32_t timeout) {
             break;
         }
         _header_buf[ret - 2] = '\0';
-
-        char* p_sep = strchr(_header_buf, ':');
-        if (p_sep == nullptr) {
-            WARNING("parse http response header [%s] failed. ignore", _header_buf);
-            continue;
-        }
-        *p_sep = '\0';
-        // trim
-        for (char *p = p_sep; p > _header_buf; --p) {
-            if (*p != ' ' && *p != '\t') {
-                break;
-            }
-            *p = '\0';
-        }
-        ++p_sep;
-        while (*p_sep == ' ' || *p_sep == '\t') {
-            ++p_sep;
-        }
-        _headers.emplace(_header_buf, p_sep);
-        DEBUG("http response header: [%s : %s]", _header_buf, p_sep);
+        parse_header_line();
 
         if (timer.timeout(&remain)) {
             return NET_TIMEOUT;
@@ -259,19 +246,13 @@ int HttpResponse::read_header(Readable* readable, int32_t timeout) {
 
 int HttpResponse::read_normal_body(Readable* readable, int32_t timeout) {
     size_t body_len = 0;
-    auto iter = _headers.find("Content-Length");
-    if (iter != _headers.end()) {
-        try {
-            body_len = std::stoull(iter->second);
-        } catch (...) {
-            body_len = 0;
-            WARNING("invalid http response content-type [%s]", iter->second.c_str());
-            return NET_PARSE_MESSAGE_FAIL;
-        }
+    int err = parse_content_length(&body_len);
+    if (err != NET_SUCC) {
+        return err;
     }
 
     if (body_len > 0) {
-        _body.reserve(body_len + 1);
+        _body.resize(body_len + 1);
         ssize_t ret = readable->read(&*(_body.begin()), body_len, timeout);
         _body[body_len] = '\0';
         if (ret != body_len) {
@@ -306,16 +287,12 @@ int HttpResponse::read_one_chunk(Readable* readable, int32_t timeout) {
     _header_buf[ret] = '\0';
 
     unsigned long chunk_size = 0;
-    _ext_buf[0] = '\0';
-    int err = sscanf(_header_buf, "%lx%511s\r\n", &chunk_size, _ext_buf);
-    if (err < 1) {
-        WARNING("parse chunk header [%s] failed:%d", _header_buf, err);
-        return NET_MESSAGE_NOT_MATCH;
+    int err = parse_chunk_header(&chunk_size);
+    if (err != NET_SUCC) {
+        return err;
     }
 
-    _chunks.emplace_back(chunk_size);
     ChunkData& chunk = _chunks.back();
-    chunk._chunk_extension = _ext_buf;
     ret = readable->read(chunk._chunk_data.get(), chunk_size + 2, timeout);
     if (ret != chunk_size + 2) {
         WARNING("read one chunk failed. expect size[%lu] ret[%l]", chunk_size, ret);
@@ -327,6 +304,199 @@ int HttpResponse::read_one_chunk(Readable* readable, int32_t timeout) {
     return chunk_size;
 }
 
+int HttpResponse::parse_status_line() {
+    int err = sscanf(_header_buf, "HTTP/%u.%u %u %511s\r\n",
+            &(_version.first), &(_version.second), &_code, _ext_buf);
+    if (err != 4) {
+        WARNING("parse http repsponse status line [%s] failed.", _header_buf);
+        return NET_MESSAGE_NOT_MATCH;
+    }
+    
+    _reason = _ext_buf;
+    DEBUG("http response status line: [HTTP/%u.%u %03u %s]", _version.first, _version.second, _code, _reason.c_str());
+    return NET_SUCC;
+}
+
+void HttpResponse::parse_header_line() {
+    char* p_sep = strchr(_header_buf, ':');
+    if (p_sep == nullptr) {
+        WARNING("parse http response header [%s] failed. ignore", _header_buf);
+        return;
+    }
+    *p_sep = '\0';
+    // trim
+    for (char *p = p_sep; p > _header_buf; --p) {
+        if (*p != ' ' && *p != '\t') {
+            break;
+        }
+        *p = '\0';
+    }
+    ++p_sep;
+    while (*p_sep == ' ' || *p_sep == '\t') {
+        ++p_sep;
+    }
+    _headers.emplace(_header_buf, p_sep);
+    DEBUG("http response header: [%s : %s]", _header_buf, p_sep);
+}
+
+int HttpResponse::parse_chunk_header(unsigned long* chunk_size) {
+    _ext_buf[0] = '\0';
+    int err = sscanf(_header_buf, "%lx%511s\r\n", chunk_size, _ext_buf);
+    if (err < 1) {
+        WARNING("parse chunk header [%s] failed:%d", _header_buf, err);
+        return NET_MESSAGE_NOT_MATCH;
+    }
+
+    _chunks.emplace_back(*chunk_size);
+    _chunks.back()._chunk_extension = _ext_buf;
+    return NET_SUCC;
+}
+
+int HttpResponse::parse_content_length(size_t* body_len) {
+    *body_len = 0;
+    auto iter = _headers.find("Content-Length");
+    if (iter != _headers.end()) {
+        try {
+            *body_len = std::stoull(iter->second);
+        } catch (...) {
+            *body_len = 0;
+            WARNING("invalid http response content-type [%s]", iter->second.c_str());
+            return NET_PARSE_MESSAGE_FAIL;
+        }
+    }
+    return NET_SUCC;
+}
+
+ParseResult HttpResponse::consume(const char* buf, size_t len, size_t* consumed) {
+    size_t pos = 0;
+    ParseResult result = _parse_state == FINISHED ? PARSE_DONE : PARSE_NEED_MORE;
+    while (result == PARSE_NEED_MORE && pos < len) {
+        size_t used = 0;
+        switch (_parse_state) {
+        case BODY:
+            result = consume_body(buf + pos, len - pos, &used);
+            break;
+        case CHUNK_DATA:
+            result = consume_chunk_data(buf + pos, len - pos, &used);
+            break;
+        default:
+            result = consume_line(buf + pos, len - pos, &used);
+            break;
+        }
+        if (used == 0) {
+            // incomplete line, wait for more data
+            break;
+        }
+        pos += used;
+    }
+    *consumed = pos;
+    return result;
+}
+
+ParseResult HttpResponse::consume_line(const char* buf, size_t len, size_t* consumed) {
+    *consumed = 0;
+    const char* lf = static_cast<const char*>(memchr(buf, '\n', len));
+    size_t line_len = lf == nullptr ? len : lf - buf + 1;
+    if (line_len >= sizeof(_header_buf)) {
+        WARNING("http response line exceeds %lu bytes", sizeof(_header_buf) - 1);
+        return PARSE_ERROR;
+    }
+    if (lf == nullptr) {
+        return PARSE_NEED_MORE;
+    }
+    *consumed = line_len;
+
+    // strip line break
+    --line_len;
+    if (line_len > 0 && buf[line_len - 1] == '\r') {
+        --line_len;
+    }
+    memcpy(_header_buf, buf, line_len);
+    _header_buf[line_len] = '\0';
+
+    switch (_parse_state) {
+    case STATUS_LINE:
+        if (parse_status_line() != NET_SUCC) {
+            return PARSE_ERROR;
+        }
+        _parse_state = HEADER_LINE;
+        return PARSE_NEED_MORE;
+    case HEADER_LINE:
+        if (line_len == 0) {
+            return on_headers_end();
+        }
+        parse_header_line();
+        return PARSE_NEED_MORE;
+    case CHUNK_HEADER: {
+        unsigned long chunk_size = 0;
+        if (parse_chunk_header(&chunk_size) != NET_SUCC) {
+            return PARSE_ERROR;
+        }
+        _data_read = 0;
+        _parse_state = CHUNK_DATA;
+        return PARSE_NEED_MORE;
+    }
+    default:
+        return PARSE_ERROR;
+    }
+}
+
+ParseResult HttpResponse::on_headers_end() {
+    if (has_header("Content-Length")) {
+        if (parse_content_length(&_body_len) != NET_SUCC) {
+            return PARSE_ERROR;
+        }
+        if (_body_len > 0) {
+            _body.resize(_body_len + 1);
+            _body[_body_len] = '\0';
+            _data_read = 0;
+            _parse_state = BODY;
+            return PARSE_NEED_MORE;
+        }
+    } else if (get_header("Transfer-Encoding") == "chunked") {
+        _is_chunked = true;
+        _parse_state = CHUNK_HEADER;
+        return PARSE_NEED_MORE;
+    }
+    _parse_state = FINISHED;
+    return PARSE_DONE;
+}
+
+ParseResult HttpResponse::consume_body(const char* buf, size_t len, size_t* consumed) {
+    size_t size = std::min(len, _body_len - _data_read);
+    memcpy(&_body[_data_read], buf, size);
+    _data_read += size;
+    *consumed = size;
+    if (_data_read < _body_len) {
+        return PARSE_NEED_MORE;
+    }
+    _parse_state = FINISHED;
+    return PARSE_DONE;
+}
+
+ParseResult HttpResponse::consume_chunk_data(const char* buf, size_t len, size_t* consumed) {
+    ChunkData& chunk = _chunks.back();
+    // chunk data followed by CRLF
+    size_t total = chunk.size() + 2;
+    size_t size = std::min(len, total - _data_read);
+    memcpy(chunk._chunk_data.get() + _data_read, buf, size);
+    _data_read += size;
+    *consumed = size;
+    if (_data_read < total) {
+        return PARSE_NEED_MORE;
+    }
+    chunk._chunk_data[chunk.size()] = '\0';
+    DEBUG("read one chunk, size[%lu] extension[%s]", chunk.size(), chunk._chunk_extension.c_str());
+
+    if (chunk.size() == 0) {
+        // last chunk
+        _parse_state = FINISHED;
+        return PARSE_DONE;
+    }
+    _parse_state = CHUNK_HEADER;
+    return PARSE_NEED_MORE;
+}
+
 REGISTER_REQUEST(HttpRequest, http)
 REGISTER_RESPONSE(HttpResponse, http)
 
@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "interface/message.h"
+#include "slab_allocator.h"
 #include "utils/common_flags.h"
 
 // TODO compression support
@@ -134,7 +135,7 @@ private:
     std::string _host;
     HttpHeaders _headers;
 
-    typedef std::vector<char> AutoBuffer;
+    typedef std::vector<char, common::SlabStlAllocator<char> > AutoBuffer;
     AutoBuffer _body;
 
     char _header_buf[WRPC_HTTP_MAX_HEADER_SIZE];
@@ -152,7 +153,7 @@ public:
     ChunkData() : _chunk_size(0) {}
     explicit ChunkData(size_t size)
         : _chunk_size(size),
-          _chunk_data(new char[_chunk_size + 2]) {
+          _chunk_data(_chunk_size + 2) {
         _chunk_data[0] = '\0';
     }
     ~ChunkData() {}
@@ -166,7 +167,7 @@ private:
     friend class HttpResponse;
     size_t _chunk_size;
     std::string _chunk_extension;
-    std::unique_ptr<char[]> _chunk_data;
+    common::SlabBuffer _chunk_data;
 };
 
 typedef std::deque<ChunkData> ChunkList;
@@ -179,6 +180,10 @@ public:
 
     virtual int read_from(Readable* readable, int32_t timeout);
 
+    virtual bool support_consume() const { return true; }
+    virtual void reset();
+    virtual ParseResult consume(const char* buf, size_t len, size_t* consumed);
+
     //void set_chunk_callback(const OnChunkData& callback) {
     //    _chunk_callback = callback;
     //}
@@ -193,7 +198,8 @@ public:
     
     bool is_chunked() const { return _is_chunked; }
 
-    size_t body_len() const { return _body.size(); }
+    // trailing '\0' is not counted
+    size_t body_len() const { return _body.size() - 1; }
     const char* body() const { return &*(_body.begin()); }
 
     const ChunkList& chunks() const { return _chunks; }
@@ -205,6 +211,27 @@ private:
 
     int read_one_chunk(Readable* readable, int32_t timeout);
 
+    // _header_bufеһ, βȥ
+    int parse_status_line();
+    void parse_header_line();
+    int parse_chunk_header(unsigned long* chunk_size);
+    int parse_content_length(size_t* body_len);
+
+    // consumeĸ׶
+    ParseResult consume_line(const char* buf, size_t len, size_t* consumed);
+    ParseResult on_headers_end();
+    ParseResult consume_body(const char* buf, size_t len, size_t* consumed);
+    ParseResult consume_chunk_data(const char* buf, size_t len, size_t* consumed);
+
+    enum ParseState {
+        STATUS_LINE = 0,
+        HEADER_LINE,
+        BODY,
+        CHUNK_HEADER,
+        CHUNK_DATA,
+        FINISHED,
+    };
+
 private:
     unsigned int _code;
     std::string _reason;
@@ -213,7 +240,7 @@ private:
     bool _is_chunked;
 
     // response body if is not chunked
-    typedef std::vector<char> AutoBuffer;
+    typedef std::vector<char, common::SlabStlAllocator<char> > AutoBuffer;
     AutoBuffer _body;
     
     //OnChunkData _chunk_callback;
@@ -221,6 +248,11 @@ private:
 
     char _header_buf[WRPC_HTTP_MAX_HEADER_LINE_LEN];
     char _ext_buf[512]; // max 512 bytes
+
+    // state of consume
+    ParseState _parse_state;
+    size_t _body_len;
+    size_t _data_read; // bytes read of body or current chunk
 };
 
 } // end namespace wrpc
@@ -14,6 +14,9 @@
  
 #include "message/redis_message.h"
 
+#include <string.h>
+#include <algorithm>
+
 #include "utils/common_define.h"
 #include "utils/timer.h"
 #include "utils/write_log.h"
@@ -48,11 +51,11 @@ int RedisResponse::read_from(Readable* readable, int32_t timeout) {
 
     MillisecondsCountdownTimer timer(timeout);
     MillisecondsCountdownTimer::rep_type remain = timeout;
-    _list.clear();
+    reset();
 
     // read first line
     ssize_t ret = readable->read_line(_buffer, sizeof(_buffer) - 1, remain);
-    if (ret <= 3) {
+    if (ret < 3) {
         return ret < 0 ? ret : NET_PARSE_MESSAGE_FAIL;
     }
 
@@ -72,7 +75,7 @@ int RedisResponse::read_from(Readable* readable, int32_t timeout) {
         DEBUG("redis response line[%s] bulk count[%d]", _buffer, res_cnt);
         for (unsigned int i = 0; i < res_cnt; ++i) {
             ret = readable->read_line(_buffer, sizeof(_buffer) - 1, remain);
-            if (ret <= 3) {
+            if (ret < 3) {
                 return ret < 0 ? ret : NET_PARSE_MESSAGE_FAIL;
             }
 
@@ -95,6 +98,13 @@ int RedisResponse::read_from(Readable* readable, int32_t timeout) {
 }
 
 int RedisResponse::read_one_item(Readable* readable, int32_t timeout_ms) {
+    if (_buffer[0] == '$') {
+        return read_bulk_res(readable, timeout_ms);
+    }
+    return parse_simple_item();
+}
+
+int RedisResponse::parse_simple_item() {
     switch (_buffer[0]) {
     case '+':
         return read_status_res();
@@ -102,8 +112,6 @@ int RedisResponse::read_one_item(Readable* readable, int32_t timeout_ms) {
         return read_error_res();
     case ':':
         return read_integer_res();
-    case '$':
-        return read_bulk_res(readable, timeout_ms);
     default:
         return NET_MESSAGE_NOT_MATCH;
     }
@@ -150,17 +158,24 @@ int RedisResponse::read_integer_res() {
     return NET_SUCC;
 }
 
-int RedisResponse::read_bulk_res(Readable* readable, int32_t timeout) {
-    int bulk_len = 0;
-    if (1 != sscanf(_buffer, "$%d\r\n", &bulk_len)) {
+int RedisResponse::parse_bulk_len(int* bulk_len) {
+    if (1 != sscanf(_buffer, "$%d\r\n", bulk_len)) {
         WARNING("redis response bulk length line[%s] illegal", _buffer);
         return NET_PARSE_MESSAGE_FAIL;
     }
 
-    if (bulk_len < 0) {
+    if (*bulk_len < 0) {
         DEBUG("redis response line[%s] nil", _buffer);
         _list.emplace_back(NIL, 0);
-        return NET_SUCC;
+    }
+    return NET_SUCC;
+}
+
+int RedisResponse::read_bulk_res(Readable* readable, int32_t timeout) {
+    int bulk_len = 0;
+    int err = parse_bulk_len(&bulk_len);
+    if (err != NET_SUCC || bulk_len < 0) {
+        return err;
     }
 
     _list.emplace_back(BULK, bulk_len);
@@ -174,6 +189,123 @@ int RedisResponse::read_bulk_res(Readable* readable, int32_t timeout) {
     return NET_SUCC;
 }
 
+void RedisResponse::reset() {
+    _list.clear();
+    _line_len = 0;
+    _parse_state = FIRST_LINE;
+    _items_left = 0;
+    _data_read = 0;
+}
+
+ParseResult RedisResponse::consume(const char* buf, size_t len, size_t* consumed) {
+    size_t pos = 0;
+    ParseResult result = _parse_state == FINISHED ? PARSE_DONE : PARSE_NEED_MORE;
+    while (result == PARSE_NEED_MORE && pos < len) {
+        size_t used = 0;
+        if (_parse_state == BULK_DATA) {
+            result = consume_bulk_data(buf + pos, len - pos, &used);
+        } else {
+            result = consume_line(buf + pos, len - pos, &used);
+        }
+        if (used == 0) {
+            // incomplete line, wait for more data
+            break;
+        }
+        pos += used;
+    }
+    *consumed = pos;
+    return result;
+}
+
+ParseResult RedisResponse::consume_line(const char* buf, size_t len, size_t* consumed) {
+    *consumed = 0;
+    const char* lf = static_cast<const char*>(memchr(buf, '\n', len));
+    size_t line_len = lf == nullptr ? len : lf - buf + 1;
+    if (line_len >= sizeof(_buffer)) {
+        WARNING("redis response line exceeds %lu bytes", sizeof(_buffer) - 1);
+        return PARSE_ERROR;
+    }
+    if (lf == nullptr) {
+        return PARSE_NEED_MORE;
+    }
+    // type and CRLF at least, "+\r\n" is an empty status
+    if (line_len < 3) {
+        WARNING("redis response line too short: %lu", line_len);
+        return PARSE_ERROR;
+    }
+    *consumed = line_len;
+    memcpy(_buffer, buf, line_len);
+    _buffer[line_len - 2] = '\0';
+    _line_len = line_len - 2;
+
+    if (_parse_state == FIRST_LINE && _buffer[0] == '*') {
+        int res_cnt = 0;
+        if (1 != sscanf(_buffer, "*%d", &res_cnt)) {
+            WARNING("redis response bulk length line[%s] illegal", _buffer);
+            return PARSE_ERROR;
+        }
+        DEBUG("redis response line[%s] bulk count[%d]", _buffer, res_cnt);
+        if (res_cnt <= 0) {
+            _parse_state = FINISHED;
+            return PARSE_DONE;
+        }
+        _items_left = res_cnt;
+        _parse_state = ITEM_LINE;
+        return PARSE_NEED_MORE;
+    }
+
+    if (_buffer[0] == '$') {
+        int bulk_len = 0;
+        if (parse_bulk_len(&bulk_len) != NET_SUCC) {
+            return PARSE_ERROR;
+        }
+        if (bulk_len < 0) {
+            return finish_item();
+        }
+        _list.emplace_back(BULK, bulk_len);
+        _data_read = 0;
+        _parse_state = BULK_DATA;
+        return PARSE_NEED_MORE;
+    }
+
+    if (parse_simple_item() != NET_SUCC) {
+        return PARSE_ERROR;
+    }
+    return finish_item();
+}
+
+ParseResult RedisResponse::consume_bulk_data(const char* buf, size_t len, size_t* consumed) {
+    RedisReponseItem& item = _list.back();
+    // bulk data followed by CRLF, empty bulk has no buffer
+    size_t total = item.data_len() + 2;
+    size_t size = std::min(len, total - _data_read);
+    if (item._data) {
+        memcpy(item._data.get() + _data_read, buf, size);
+    }
+    _data_read += size;
+    *consumed = size;
+    if (_data_read < total) {
+        return PARSE_NEED_MORE;
+    }
+    if (item._data) {
+        item._data[item.data_len()] = '\0';
+    }
+    DEBUG("redis response bulk len[%lu]", item.data_len());
+    return finish_item();
+}
+
+ParseResult RedisResponse::finish_item() {
+    if (_items_left > 0) {
+        --_items_left;
+    }
+    if (_items_left > 0) {
+        _parse_state = ITEM_LINE;
+        return PARSE_NEED_MORE;
+    }
+    _parse_state = FINISHED;
+    return PARSE_DONE;
+}
+
 REGISTER_REQUEST(RedisRequest, redis)
 REGISTER_RESPONSE(RedisResponse, redis)
  
@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "interface/message.h"
+#include "slab_allocator.h"
 #include "utils/string_utils.h"
 
 namespace wrpc {
@@ -75,7 +76,7 @@ public:
         : _type(type),
           _int_data(0),
           _data_len(data_len),
-          _data(data_len == 0 ? nullptr : new char[_data_len + 2]) {}
+          _data(data_len == 0 ? 0 : _data_len + 2) {}
     ~RedisReponseItem() {}
 
     // getter
@@ -94,18 +95,22 @@ private:
     std::string _message;
     std::string _detail;
     size_t _data_len;
-    std::unique_ptr<char[]> _data;
+    common::SlabBuffer _data;
 };
 
 typedef std::deque<RedisReponseItem> RedisReponseList;
 
 class RedisResponse : public IResponse {
 public:
-    RedisResponse() {}
+    RedisResponse() : _line_len(0), _parse_state(FIRST_LINE), _items_left(0), _data_read(0) {}
     virtual ~RedisResponse() {}
 
     virtual int read_from(Readable* readable, int32_t timeout);
 
+    virtual bool support_consume() const { return true; }
+    virtual void reset();
+    virtual ParseResult consume(const char* buf, size_t len, size_t* consumed);
+
     const RedisReponseList& response_list() const { return _list; }
 
 private:
@@ -116,10 +121,32 @@ private:
     int read_integer_res();
     int read_bulk_res(Readable* readable, int32_t timeout);
 
+    // _bufferеstatus/error/integer
+    int parse_simple_item();
+    // _bufferеbulk, <0ʱNIL
+    int parse_bulk_len(int* bulk_len);
+
+    // consumeĸ׶
+    ParseResult consume_line(const char* buf, size_t len, size_t* consumed);
+    ParseResult consume_bulk_data(const char* buf, size_t len, size_t* consumed);
+    ParseResult finish_item();
+
+    enum ParseState {
+        FIRST_LINE = 0,
+        ITEM_LINE,
+        BULK_DATA,
+        FINISHED,
+    };
+
 private:
     char _buffer[1024];
     size_t _line_len;
     RedisReponseList _list;
+
+    // state of consume
+    ParseState _parse_state;
+    unsigned int _items_left; // items left of multi bulk reply
+    size_t _data_read; // bytes read of current bulk
 };
  
 } // end namespace wrpc
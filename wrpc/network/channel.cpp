@@ -58,7 +58,7 @@ int Channel::init(const std::string& address, const ChannelOptions& options) {
         return NET_INVALID_ARGUMENT;
     }
 
-    _options = options;
+    _protocol = options.protocol;
     _naming_service = NamingServiceFactory::get_instance().make_unique(
             naming_protocol, naming_protocol);
     if (!_naming_service) {
@@ -68,25 +68,11 @@ int Channel::init(const std::string& address, const ChannelOptions& options) {
         return NET_INVALID_ARGUMENT;
     }
 
-    _lb = LBFactory::get_instance().make_unique(
-            _options.load_balancer, _options.load_balancer);
-    if (!_lb) {
+    ChannelSnapshotPtr snapshot;
+    int ret = make_snapshot(options, nullptr, &snapshot);
+    if (ret != NET_SUCC) {
         release();
-        WARNING("Channel::init load balancer for [%s] failed",
-                _options.load_balancer.c_str());
-        return NET_INVALID_ARGUMENT;
-    }
-
-    if (!_options.retry_policy.empty() && _options.retry_policy != _options.load_balancer) {
-        _retry_policy = LBFactory::get_instance().make_unique(
-                _options.retry_policy, _options.retry_policy);
-        if (!_retry_policy) {
-            release();
-            WARNING("Channel::init retry policy for [%s] failed",
-                    _options.retry_policy.c_str());
-            return NET_INVALID_ARGUMENT;
-
-        }
+        return ret;
     }
 
     _endpoint_manager.reset(new (std::nothrow) EndPointManager());
@@ -96,25 +82,28 @@ int Channel::init(const std::string& address, const ChannelOptions& options) {
         return NET_INTERNAL_ERROR;
     }
 
-    _endpoint_manager->set_connection_type(_options.connection_type);
-    _endpoint_manager->set_max_error_count(_options.max_error_count_per_endpoint);
-    _endpoint_manager->set_connect_pool_capacity(_options.max_connection_per_endpoint);
+    _endpoint_manager->set_connection_type(options.connection_type);
+    _endpoint_manager->set_io_backend(options.io_backend);
+    _endpoint_manager->set_socket_busy_poll(options.socket_busy_poll_us);
+    _endpoint_manager->set_max_error_count(options.max_error_count_per_endpoint);
+    _endpoint_manager->set_connect_pool_capacity(options.max_connection_per_endpoint);
 
     // add listening
     _naming_service->add_observer(_endpoint_manager.get());
-    _endpoint_manager->add_watcher(_lb.get());
-    if (_retry_policy) {
-        _endpoint_manager->add_watcher(_retry_policy.get());
+    _endpoint_manager->add_watcher(snapshot->lb.get());
+    if (snapshot->retry_policy) {
+        _endpoint_manager->add_watcher(snapshot->retry_policy.get());
     }
+    std::atomic_store(&_snapshot, snapshot);
 
     // register back ground tasks
     _naming_service->refresh(_real_address);
     _refresh_task->start(std::bind(&Channel::refresh_endpoints, shared_from_this()),
-            _options.update_end_points_interval);
+            options.update_end_points_interval);
 
     _health_check_task->start(
             std::bind(&Channel::do_health_check, shared_from_this()),
-            _options.health_check_interval);
+            options.health_check_interval);
     return NET_SUCC;
 }
 
@@ -142,26 +131,12 @@ int Channel::init(const EndPointList& end_point_list, const ChannelOptions& opti
         return NET_INVALID_ARGUMENT;
     }
 
-    _options = options;
-    _lb = LBFactory::get_instance().make_unique(
-            _options.load_balancer, _options.load_balancer);
-    if (!_lb) {
+    _protocol = options.protocol;
+    ChannelSnapshotPtr snapshot;
+    int ret = make_snapshot(options, nullptr, &snapshot);
+    if (ret != NET_SUCC) {
         release();
-        WARNING("Channel::init load balancer for [%s] failed",
-                _options.load_balancer.c_str());
-        return NET_INVALID_ARGUMENT;
-    }
-
-    if (!_options.retry_policy.empty() && _options.retry_policy != _options.load_balancer) {
-        _retry_policy = LBFactory::get_instance().make_unique(
-                _options.retry_policy, _options.retry_policy);
-        if (!_retry_policy) {
-            release();
-            WARNING("Channel::init retry policy for [%s] failed",
-                    _options.retry_policy.c_str());
-            return NET_INVALID_ARGUMENT;
-
-        }
+        return ret;
     }
 
     _endpoint_manager.reset(new (std::nothrow) EndPointManager());
@@ -170,16 +145,104 @@ int Channel::init(const EndPointList& end_point_list, const ChannelOptions& opti
         WARNING("Channel::init allocate EndPointManager failed");
         return NET_INTERNAL_ERROR;
     }
-    _endpoint_manager->set_connection_type(_options.connection_type);
-    _endpoint_manager->set_max_error_count(_options.max_error_count_per_endpoint);
-    _endpoint_manager->set_connect_pool_capacity(_options.max_connection_per_endpoint);
+    _endpoint_manager->set_connection_type(options.connection_type);
+    _endpoint_manager->set_io_backend(options.io_backend);
+    _endpoint_manager->set_socket_busy_poll(options.socket_busy_poll_us);
+    _endpoint_manager->set_max_error_count(options.max_error_count_per_endpoint);
+    _endpoint_manager->set_connect_pool_capacity(options.max_connection_per_endpoint);
 
     // update endpoint list
     _endpoint_manager->on_update(end_point_list);
-    _lb->on_update_all(end_point_list);
-    if (_retry_policy) {
-        _retry_policy->on_update_all(end_point_list);
+    snapshot->lb->on_update_all(end_point_list);
+    if (snapshot->retry_policy) {
+        snapshot->retry_policy->on_update_all(end_point_list);
     }
+    std::atomic_store(&_snapshot, snapshot);
+    return NET_SUCC;
+}
+
+int Channel::update_options(const ChannelOptions& options) {
+    std::lock_guard<std::mutex> lock(_update_mutex);
+    ChannelSnapshotPtr current = snapshot();
+    if (!current || !_endpoint_manager) {
+        WARNING("Channel::update_options channel not inited");
+        return NET_INTERNAL_ERROR;
+    }
+    // io backend and busy poll are applied to connections when created, pooled ones would
+    // keep the old settings
+    if (options.protocol != current->options.protocol
+            || options.connection_type != current->options.connection_type
+            || options.io_backend != current->options.io_backend
+            || options.socket_busy_poll_us != current->options.socket_busy_poll_us) {
+        WARNING("Channel::update_options protocol, connection type, io backend "
+                "and socket busy poll can not be updated");
+        return NET_INVALID_ARGUMENT;
+    }
+
+    ChannelSnapshotPtr snapshot;
+    int ret = make_snapshot(options, current.get(), &snapshot);
+    if (ret != NET_SUCC) {
+        return ret;
+    }
+
+    // new strategies start watching before published, replaced ones stop after
+    // in-flight rpcs holding the old snapshot can still use them
+    if (snapshot->lb != current->lb) {
+        _endpoint_manager->add_watcher_with_end_points(snapshot->lb.get());
+    }
+    if (snapshot->retry_policy && snapshot->retry_policy != current->retry_policy) {
+        _endpoint_manager->add_watcher_with_end_points(snapshot->retry_policy.get());
+    }
+    _endpoint_manager->update_options(options.max_error_count_per_endpoint,
+            options.max_connection_per_endpoint);
+    std::atomic_store(&_snapshot, snapshot);
+
+    if (snapshot->lb != current->lb) {
+        _endpoint_manager->remove_watcher(current->lb.get());
+    }
+    if (current->retry_policy && snapshot->retry_policy != current->retry_policy) {
+        _endpoint_manager->remove_watcher(current->retry_policy.get());
+    }
+    return NET_SUCC;
+}
+
+int Channel::make_snapshot(const ChannelOptions& options, const ChannelSnapshot* base,
+        ChannelSnapshotPtr* snapshot) {
+    std::shared_ptr<ChannelSnapshot> result(new (std::nothrow) ChannelSnapshot());
+    if (!result) {
+        WARNING("Channel::make_snapshot allocate ChannelSnapshot failed");
+        return NET_INTERNAL_ERROR;
+    }
+    result->options = options;
+
+    if (base != nullptr && base->options.load_balancer == options.load_balancer) {
+        result->lb = base->lb;
+    } else {
+        result->lb = LBFactory::get_instance().make_unique(
+                options.load_balancer, options.load_balancer);
+        if (!result->lb) {
+            WARNING("Channel::make_snapshot load balancer for [%s] failed",
+                    options.load_balancer.c_str());
+            return NET_INVALID_ARGUMENT;
+        }
+    }
+
+    if (!options.retry_policy.empty() && options.retry_policy != options.load_balancer) {
+        if (base != nullptr && base->retry_policy
+                && base->options.retry_policy == options.retry_policy) {
+            result->retry_policy = base->retry_policy;
+        } else {
+            result->retry_policy = LBFactory::get_instance().make_unique(
+                    options.retry_policy, options.retry_policy);
+            if (!result->retry_policy) {
+                WARNING("Channel::make_snapshot retry policy for [%s] failed",
+                        options.retry_policy.c_str());
+                return NET_INVALID_ARGUMENT;
+            }
+        }
+    }
+
+    *snapshot = result;
     return NET_SUCC;
 }
 
@@ -188,25 +251,24 @@ void Channel::release() {
     _health_check_task->cancel();
 
     _endpoint_manager.reset();
-    _retry_policy.reset();
-    _lb.reset();
+    std::atomic_store(&_snapshot, ChannelSnapshotPtr());
     _naming_service.reset();
 }
 
 IRequest* Channel::make_request() {
-    return RequestFactory::get_instance().new_instance(_options.protocol);
+    return RequestFactory::get_instance().new_instance(_protocol);
 }
 
 IResponse* Channel::make_response() {
-    return ResponseFactory::get_instance().new_instance(_options.protocol);
+    return ResponseFactory::get_instance().new_instance(_protocol);
 }
 
 void Channel::destroy_request(IRequest* request) {
-    RequestFactory::get_instance().destroy_instance(_options.protocol, request);
+    RequestFactory::get_instance().destroy_instance(_protocol, request);
 }
 
 void Channel::destroy_response(IResponse* response) {
-    ResponseFactory::get_instance().destroy_instance(_options.protocol, response);
+    ResponseFactory::get_instance().destroy_instance(_protocol, response);
 }
 
 #if WRPC_USE_CONTROLLER_INST_POOL_CAPACITY > 0
@@ -233,13 +295,22 @@ ControllerPtr Channel::create_controller() {
                     }
                 });
     });
-    return s_controller_pool->fetch_shared(shared_from_this(), _options.default_rpc_options());
+    ChannelSnapshotPtr current = snapshot();
+    if (!current) {
+        return ControllerPtr();
+    }
+    return s_controller_pool->fetch_shared(shared_from_this(),
+            current->options.default_rpc_options());
 }
 #else
 // ʹö
 ControllerPtr Channel::create_controller() {
+    ChannelSnapshotPtr current = snapshot();
+    if (!current) {
+        return ControllerPtr();
+    }
     return ControllerPtr(new (std::nothrow) Controller(
-            shared_from_this(), _options.default_rpc_options()), [] (Controller* controller) {
+            shared_from_this(), current->options.default_rpc_options()), [] (Controller* controller) {
         if (controller != nullptr) {
             delete controller;
         }
@@ -249,13 +320,15 @@ ControllerPtr Channel::create_controller() {
 
 int Channel::fetch_connection(LoadBalancerContext& context,
         int32_t timeout_ms, ConnectionPtr& connection) {
-    if (_lb && _endpoint_manager) {
+    // hold the snapshot, strategies may be replaced by update_options meanwhile
+    ChannelSnapshotPtr current = snapshot();
+    if (current && _endpoint_manager) {
         LoadBalancer* lb = nullptr;
-        if (context.retry_count > 0 && _retry_policy) {
+        if (context.retry_count > 0 && current->retry_policy) {
             // do retry with retry polict
-            lb = _retry_policy.get();
+            lb = current->retry_policy.get();
         } else {
-            lb = _lb.get();
+            lb = current->lb.get();
         }
         LoadBalancerOutput lb_out = lb->select(context);
         if (lb_out.first == NET_SUCC) {
@@ -285,8 +358,9 @@ void Channel::feedback(const FeedbackInfo& info) {
     DEBUG("feedback ep[%s] code[%d] cost[%u] conn[%u] write[%u] read[%u]",
             info.endpoint.to_string().c_str(), info.code, info.total_cost,
             info.connect_cost, info.write_cost, info.read_cost);
-    if (_lb) {
-        _lb->feedback(info);
+    ChannelSnapshotPtr current = snapshot();
+    if (current) {
+        current->lb->feedback(info);
     }
 }
 
@@ -309,8 +383,9 @@ void Channel::refresh_endpoints(ChannelWeakPtr channel) {
 
 void Channel::do_health_check(ChannelWeakPtr channel) {
     ChannelPtr locked = channel.lock();
-    if (locked && locked->_endpoint_manager) {
-        locked->_endpoint_manager->health_check(locked->_options.connect_timeout_ms);
+    ChannelSnapshotPtr current = locked ? locked->snapshot() : ChannelSnapshotPtr();
+    if (current && locked->_endpoint_manager) {
+        locked->_endpoint_manager->health_check(current->options.connect_timeout_ms);
         DEBUG("do health chack.");
     }
 }
@@ -9,6 +9,8 @@
 #ifndef WRPC_NETWORK_CHANNEL_H_
 #define WRPC_NETWORK_CHANNEL_H_
 
+#include <mutex>
+
 #include "common/options.h"
 #include "common/rpc_feedback.h"
 #include "interface/load_balancer.h"
@@ -20,6 +22,15 @@
  
 namespace wrpc {
 
+// options and strategies of a channel, replaced as a whole by update_options
+// strategies not changed are shared between snapshots
+struct ChannelSnapshot {
+    ChannelOptions options;
+    std::shared_ptr<LoadBalancer> lb;
+    std::shared_ptr<LoadBalancer> retry_policy;
+};
+typedef std::shared_ptr<const ChannelSnapshot> ChannelSnapshotPtr;
+
 class Channel : public std::enable_shared_from_this<Channel> {
 private:
     Channel();
@@ -39,6 +50,16 @@ public:
     int init(const EndPoint& end_point, const ChannelOptions& options);
     int init(const EndPointList& end_point_list, const ChannelOptions& options);
 
+    // ʱ², ֮󴴽controllerЧ, ӳغͺбֲ
+    // protocol, connection_type, io_backend, socket_busy_poll_usͺָ̨֧
+    // ǰ仯ʱNET_INVALID_ARGUMENT
+    int update_options(const ChannelOptions& options);
+
+    ChannelOptions get_options() const {
+        ChannelSnapshotPtr current = snapshot();
+        return current ? current->options : ChannelOptions();
+    }
+
     // should be called by ChannelPtr
     ControllerPtr create_controller();
     void feedback(const FeedbackInfo& info);
@@ -59,17 +80,26 @@ private:
 
     void release();
 
+    ChannelSnapshotPtr snapshot() const {
+        return std::atomic_load(&_snapshot);
+    }
+
+    // build snapshot for options, reuse strategies of base if not changed
+    int make_snapshot(const ChannelOptions& options, const ChannelSnapshot* base,
+            ChannelSnapshotPtr* snapshot);
+
     // back ground task functions
     static void refresh_endpoints(ChannelWeakPtr);
     static void do_health_check(ChannelWeakPtr);
 
 private:
-    ChannelOptions _options;
+    std::string _protocol;
     std::string _real_address;
     std::unique_ptr<EndPointManager> _endpoint_manager;
     NamingServicePtr _naming_service;
-    LoadBalancerPtr _lb;
-    LoadBalancerPtr _retry_policy;
+    // read by atomic_load, written by atomic_store under _update_mutex
+    ChannelSnapshotPtr _snapshot;
+    std::mutex _update_mutex;
 
     // back ground tasks
     PeriodicTaskControllerPtr _refresh_task;
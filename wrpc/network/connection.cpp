@@ -9,17 +9,31 @@
 #include "network/connection.h"
 
 #include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <algorithm>
 
+#include "network/controller.h"
+#include "network/event_dispatcher.h"
 #include "utils/common_define.h"
+#include "utils/io_uring.h"
 #include "utils/net_utils.h"
 #include "utils/timer.h"
 #include "utils/write_log.h"
  
 namespace wrpc {
  
-Connection::Connection(const EndPoint& end_point)
-    : _end_point(end_point), _sock_fd(-1) {}
+Connection::Connection(const EndPoint& end_point, IOBackend io_backend, uint32_t busy_poll_us)
+    : _end_point(end_point),
+      _sock_fd(-1),
+      _io_backend(io_backend),
+      _busy_poll_us(busy_poll_us),
+      _dispatcher_index(next_event_dispatcher_index()),
+      _id(INVALID_CONNECTION_ID),
+      _owner(INVALID_CONTROLLER_ID),
+      _broken(false) {}
 
 Connection::~Connection() {
     close();
@@ -44,7 +58,21 @@ int Connection::connect(int32_t timeout_ms) {
         return NET_INTERNAL_ERROR;
     }
 
-    ret = connect_with_timeout(sock_fd, (const struct sockaddr*)(&addr), timeout_ms);
+#ifdef SO_BUSY_POLL
+    if (_busy_poll_us > 0) {
+        int busy_poll = _busy_poll_us;
+        if (setsockopt(sock_fd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)) != 0) {
+            // not fatal, keep interrupt driven receiving
+            WARNING("Connection: set SO_BUSY_POLL failed, errno: [%d:%s]", errno, strerror(errno));
+        }
+    }
+#endif
+
+    if (use_io_uring()) {
+        ret = uring_connect_with_timeout(sock_fd, (const struct sockaddr*)(&addr), timeout_ms);
+    } else {
+        ret = connect_with_timeout(sock_fd, (const struct sockaddr*)(&addr), timeout_ms);
+    }
     if (ret != NET_SUCC) {
         close_connection(sock_fd);
         WARNING("Connection: connect failed: %d address:[%s]", ret, _end_point.to_string().c_str());
@@ -56,38 +84,221 @@ int Connection::connect(int32_t timeout_ms) {
 }
 
 int Connection::close() {
+    if (_id != INVALID_CONNECTION_ID) {
+        // unregister before closing fd, closed fd is removed from epoll automatically
+        ConnectionAddresser::remove(_id);
+        _id = INVALID_CONNECTION_ID;
+    }
     int ret = close_connection(_sock_fd);
     _sock_fd = -1;
+    _read_buffer.clear();
+    _owner.store(INVALID_CONTROLLER_ID, std::memory_order_release);
+    _broken.store(false, std::memory_order_release);
     return ret;
 }
 
+int Connection::bind_owner(ControllerId owner) {
+    if (!connected()) {
+        return NET_DISCONNECTED;
+    }
+    // owner must be set before request is sent, or the response event may be taken as idle one
+    _owner.store(owner, std::memory_order_release);
+    if (_id == INVALID_CONNECTION_ID) {
+        _id = ConnectionAddresser::regist(this);
+        if (_id == INVALID_CONNECTION_ID) {
+            WARNING("Connection: too many registered connections, fd[%d]", _sock_fd);
+            _owner.store(INVALID_CONTROLLER_ID, std::memory_order_release);
+            return NET_EPOLL_FAIL;
+        }
+        EventDispatcher& dispatcher = get_event_dispatcher(_dispatcher_index);
+        if (dispatcher.add_listener(_id, _sock_fd) != 0) {
+            WARNING("Connection: listen fd[%d] failed, errno: [%d:%s]", _sock_fd, errno, strerror(errno));
+            ConnectionAddresser::remove(_id);
+            _id = INVALID_CONNECTION_ID;
+            _owner.store(INVALID_CONTROLLER_ID, std::memory_order_release);
+            return NET_EPOLL_FAIL;
+        }
+    }
+    return NET_SUCC;
+}
+
+void Connection::unbind_owner() {
+    _owner.store(INVALID_CONTROLLER_ID, std::memory_order_release);
+}
+
+void Connection::check_idle_event(uint32_t epoll_events) {
+    if (epoll_events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+        DEBUG("Connection: idle fd[%d] closed by peer", _sock_fd);
+        _broken.store(true, std::memory_order_release);
+        return;
+    }
+    // may be a late event of data consumed by last response, check if anything is readable
+    char c = 0;
+    ssize_t ret = recv(_sock_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    // eof, error or unexpected data, recheck owner in case it is fetched just now
+    if (owner() == INVALID_CONTROLLER_ID) {
+        DEBUG("Connection: idle fd[%d] broken, peek ret: %ld", _sock_fd, ret);
+        _broken.store(true, std::memory_order_release);
+    }
+}
+
+void Connection::check_owned_event(uint32_t epoll_events) {
+    if (epoll_events & (EPOLLHUP | EPOLLRDHUP)) {
+        DEBUG("Connection: fd[%d] closed by peer while owned", _sock_fd);
+        _broken.store(true, std::memory_order_release);
+    }
+}
+
+bool Connection::use_io_uring() const {
+    return _io_backend == IO_BACKEND_IO_URING && uring_available();
+}
+
+ssize_t Connection::fill_read_buffer(int32_t timeout_ms) {
+    if (use_io_uring()) {
+        // wait and receive in one io_uring_enter
+        size_t writable = 0;
+        char* space = _read_buffer.prepare(&writable);
+        if (space == nullptr) {
+            return NET_INTERNAL_ERROR;
+        }
+        ssize_t ret = uring_recv(_sock_fd, space, writable, timeout_ms);
+        if (ret > 0) {
+            _read_buffer.commit(ret);
+        }
+        return ret;
+    }
+
+    MillisecondsCountdownTimer timer(timeout_ms);
+    MillisecondsCountdownTimer::rep_type remain = timeout_ms;
+    while (true) {
+        // data usually arrives before epoll event, try without waiting
+        bool eof = false;
+        ssize_t ret = _read_buffer.fill_once(_sock_fd, &eof);
+        if (ret != 0 || eof) {
+            return ret;
+        }
+        if (timer.timeout(&remain)) {
+            return NET_TIMEOUT;
+        }
+        ret = wait_readable(_sock_fd, remain);
+        if (ret != NET_SUCC) {
+            return ret;
+        }
+    }
+}
+
 ssize_t Connection::read(char* buf, size_t size, int32_t timeout_ms) {
-    return readn(_sock_fd, buf, size, timeout_ms);
+    if (_sock_fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    if (nullptr == buf) {
+        return NET_INVALID_ARGUMENT;
+    }
+
+    MillisecondsCountdownTimer timer(timeout_ms);
+    MillisecondsCountdownTimer::rep_type remain = timeout_ms;
+    size_t done = 0;
+    while (done < size) {
+        if (!_read_buffer.empty()) {
+            size_t len = std::min(size - done, _read_buffer.size());
+            memcpy(buf + done, _read_buffer.data(), len);
+            _read_buffer.consume(len);
+            done += len;
+            continue;
+        }
+        if (size - done >= _read_buffer.capacity()) {
+            // large body, read into user buffer directly without copying
+            ssize_t ret = use_io_uring() ? uring_readn(_sock_fd, buf + done, size - done, remain)
+                    : readn(_sock_fd, buf + done, size - done, remain);
+            if (ret < 0) {
+                return ret;
+            }
+            done += ret;
+            break;
+        }
+        ssize_t ret = fill_read_buffer(remain);
+        if (ret < 0) {
+            return ret;
+        } else if (ret == 0) {
+            // eof
+            break;
+        }
+        if (timer.timeout(&remain)) {
+            // deadline passed, only take data already arrived
+            remain = 0;
+        }
+    }
+    return static_cast<ssize_t>(done);
 }
 
 ssize_t Connection::read_line(char* buf, size_t max_size, int32_t timeout_ms) {
-    return readline(_sock_fd, buf, max_size, timeout_ms);
+    if (_sock_fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    if (nullptr == buf) {
+        return NET_INVALID_ARGUMENT;
+    }
+
+    MillisecondsCountdownTimer timer(timeout_ms);
+    MillisecondsCountdownTimer::rep_type remain = timeout_ms;
+    size_t done = 0;
+    while (done < max_size) {
+        if (_read_buffer.empty()) {
+            ssize_t ret = fill_read_buffer(remain);
+            if (ret < 0) {
+                return ret;
+            } else if (ret == 0) {
+                // eof ends the line
+                break;
+            }
+            if (timer.timeout(&remain)) {
+                remain = 0;
+            }
+        }
+        const char* data = _read_buffer.data();
+        size_t len = std::min(max_size - done, _read_buffer.size());
+        const char* lf = static_cast<const char*>(memchr(data, '\n', len));
+        if (lf != nullptr) {
+            len = lf - data + 1;
+        }
+        memcpy(buf + done, data, len);
+        _read_buffer.consume(len);
+        done += len;
+        if (lf != nullptr) {
+            break;
+        }
+    }
+    return static_cast<ssize_t>(done);
 }
 
 ssize_t Connection::write(const char* buf, size_t size, int32_t timeout_ms) {
+    if (use_io_uring()) {
+        return uring_writen(_sock_fd, buf, size, timeout_ms);
+    }
     return writen(_sock_fd, buf, size, timeout_ms);
 }
 
 ConnectionPtr ConnectionPool::fetch(int32_t timeout_ms) {
     std::lock_guard<std::mutex> lock(_mutex);
-    if (_pool.empty()) {
-        return _connection_creator(timeout_ms);
-    } else {
+    while (!_pool.empty()) {
         ConnectionPtr connection = std::move(_pool.front());
         _pool.pop_front();
-        return connection;
+        if (!connection->broken()) {
+            return connection;
+        }
+        // closed by peer while idle
+        DEBUG("drop broken connection fd[%d]", connection->get_fd());
     }
+    return _connection_creator(timeout_ms);
 }
 
 void ConnectionPool::give_back(ConnectionPtr&& connection) {
     if (connection) {
         std::lock_guard<std::mutex> lock(_mutex);
-        if (_pool.size() < _max_size) {
+        if (_pool.size() < _max_size && !connection->broken()) {
             _pool.push_back(std::move(connection));
         } else {
             connection.reset();
@@ -101,6 +312,44 @@ size_t ConnectionPool::availability() const {
     return size;
 }
 
+ConnectionAddresser::ConnectionAddresser() {}
+
+ConnectionAddresser::~ConnectionAddresser() {}
+
+ConnectionAddresser& ConnectionAddresser::get_instance() {
+    static ConnectionAddresser _instance;
+    return _instance;
+}
+
+ConnectionId ConnectionAddresser::regist_internal(Connection* connection) {
+    if (connection == nullptr) {
+        return INVALID_CONNECTION_ID;
+    }
+
+    return _connections.insert(connection);
+}
+
+void ConnectionAddresser::remove_internal(ConnectionId id) {
+    // wait for dispatching of this connection to finish
+    _connections.erase(id);
+}
+
+ControllerId ConnectionAddresser::dispatch_internal(ConnectionId id, uint32_t epoll_events, int* fd) {
+    *fd = -1;
+    ControllerId owner = INVALID_CONTROLLER_ID;
+    // connection can not be removed, and so not closed, during visit
+    _connections.visit(id, [&] (Connection* connection) {
+        *fd = connection->get_fd();
+        owner = connection->owner();
+        if (owner == INVALID_CONTROLLER_ID) {
+            connection->check_idle_event(epoll_events);
+        } else {
+            connection->check_owned_event(epoll_events);
+        }
+    });
+    return owner;
+}
+
 } // namespace wrpc
  
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
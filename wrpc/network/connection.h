@@ -9,27 +9,50 @@
 #ifndef WRPC_NETWORK_CONNECTION_H_
 #define WRPC_NETWORK_CONNECTION_H_
 
+#include <atomic>
 #include <deque>
 #include <mutex>
 
 #include "common/end_point.h"
+#include "common/options.h"
 #include "interface/readable.h"
 #include "interface/writable.h"
 #include "network/network_common.h"
+#include "utils/common_define.h"
+#include "utils/read_buffer.h"
+#include "utils/slot_map.h"
 #include "utils/timer.h"
 
 namespace wrpc {
+
+static const ConnectionId INVALID_CONNECTION_ID = 0;
  
 class Connection : public Writable, public Readable {
 private:
     EndPoint _end_point;
     int _sock_fd;
+    IOBackend _io_backend;
+    // SO_BUSY_POLL set on connect, 0 for disabled
+    uint32_t _busy_poll_us;
+    // events of this connection are all dispatched by this event dispatcher
+    uint32_t _dispatcher_index;
+    // filled by incremental response parsing (see IResponse::consume) and blocking reads
+    // kept across requests while the connection is pooled
+    ReadBuffer _read_buffer;
+
+    // ״αʱעᵽevent dispatcher, ֱرնƳ
+    // ÿֻû̬owner, Ҫepoll_ctl
+    ConnectionId _id;
+    std::atomic<ControllerId> _owner;
+    // Զѹر(ڼӦһ𵽴Ĺر), ʱյԤڵ, ٸ
+    std::atomic<bool> _broken;
 
     Connection(const Connection&) = delete;
     Connection& operator = (const Connection&) = delete;
 
 public:
-    explicit Connection(const EndPoint& end_point);
+    explicit Connection(const EndPoint& end_point, IOBackend io_backend = IO_BACKEND_POLL,
+            uint32_t busy_poll_us = 0);
     ~Connection();
 
     int connect(int32_t timeout_ms);
@@ -47,6 +70,75 @@ public:
     virtual ssize_t write(const char* buf, size_t size, int32_t timeout_ms);
 
     int get_fd() const { return _sock_fd; }
+
+    IOBackend io_backend() const { return _io_backend; }
+
+    uint32_t dispatcher_index() const { return _dispatcher_index; }
+
+    ReadBuffer& read_buffer() { return _read_buffer; }
+
+    // events of the connection are dispatched to the owner controller
+    // registered to event dispatcher on first call
+    int bind_owner(ControllerId owner);
+    void unbind_owner();
+    ControllerId owner() const { return _owner.load(std::memory_order_acquire); }
+
+    bool broken() const { return _broken.load(std::memory_order_acquire); }
+
+private:
+    friend class ConnectionAddresser;
+    // called by event dispatcher when an event arrives with no owner
+    void check_idle_event(uint32_t epoll_events);
+    // called by event dispatcher when an event arrives with an owner, a connection closed by
+    // peer, e.g. right after the response, is not reused once given back
+    void check_owned_event(uint32_t epoll_events);
+    // io_uring selected and supported by current thread
+    bool use_io_uring() const;
+    // wait and receive once into read buffer, return bytes received, 0 for eof
+    ssize_t fill_read_buffer(int32_t timeout_ms);
+};
+
+// Address registered connection by connection id, connections are removed before closed
+// so that event dispatchers never touch a destroyed one, lookup is lock free
+// singleton
+class ConnectionAddresser {
+private:
+    ConnectionAddresser();
+
+    static ConnectionAddresser& get_instance();
+
+public:
+    ~ConnectionAddresser();
+
+    static ConnectionId regist(Connection* connection) {
+        return get_instance().regist_internal(connection);
+    }
+    static void remove(ConnectionId id) {
+        get_instance().remove_internal(id);
+    }
+
+    /**
+     * @brief ӵǰowner, ӿʱǷʧЧ
+     *
+     * @param [in] id : ConnectionId
+     * @param [in] epoll_events : uint32_t
+     * @param [out] fd : int*
+     *        ӵfd
+     *
+     * @return ControllerId
+     *        ӵǰowner, ӲڻʱINVALID_CONTROLLER_ID
+     */
+    static ControllerId dispatch(ConnectionId id, uint32_t epoll_events, int* fd) {
+        return get_instance().dispatch_internal(id, epoll_events, fd);
+    }
+
+private:
+    ConnectionId regist_internal(Connection* connection);
+    void remove_internal(ConnectionId id);
+    ControllerId dispatch_internal(ConnectionId id, uint32_t epoll_events, int* fd);
+
+private:
+    VersionedSlotMap<Connection*> _connections;
 };
 
 typedef std::function<ConnectionPtr (int32_t)> ConnectionCreator;
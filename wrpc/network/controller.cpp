@@ -28,6 +28,13 @@ static inline void cancel_bg_task(BackgroundTaskId& task_id) {
     }
 }
 
+static inline void cancel_timer(DispatcherTimerPtr& timer) {
+    if (timer) {
+        timer->cancel();
+        timer.reset();
+    }
+}
+
 static inline int status_2_ret_code(ControllerStatus status) {
     switch (status) {
         case SUCCESS:
@@ -43,6 +50,7 @@ static inline int status_2_ret_code(ControllerStatus status) {
 
 RequestController::RequestController(Controller* controller)
     : _is_running(false),
+      _retry_deferred(false),
       _controller(controller),
       _response(nullptr),
       _error_code(NET_UNKNOW_ERROR),
@@ -59,6 +67,10 @@ int RequestController::get_fd() const {
     return _connection ? _connection->get_fd() : -1;
 }
 
+uint32_t RequestController::dispatcher_index() const {
+    return _connection ? _connection->dispatcher_index() : 0;
+}
+
 void RequestController::feedback(int code) {
     _feedback_info.code = code;
     _feedback_info.total_cost = _timer.tick();
@@ -92,6 +104,7 @@ int RequestController::issue_rpc() {
 
     _feedback_info.reset(_connection->end_point());
     _feedback_info.connect_cost = _timer.tick();
+    _response->reset();
     // check total timeout
     MillisecondsCountdownTimer::rep_type remain;
     if(_controller->_timer.timeout(&remain)) {
@@ -101,11 +114,19 @@ int RequestController::issue_rpc() {
         return NET_TIMEOUT;
     }
 
+    // bind connection before sending request, response event is dispatched by owner
+    if (listen() != NET_SUCC) {
+        _error_code = NET_EPOLL_FAIL;
+        _controller->giveback_connection(std::move(_connection), true);
+        return retry(_error_code);
+    }
+
     // send request
     TIMER(_feedback_info.write_cost) {
         _error_code = _controller->_request->write_to(_connection.get(), remain);
     }
     if (_error_code != NET_SUCC) {
+        unlisten();
         _controller->giveback_connection(std::move(_connection), true);
         return retry(_error_code);
     }
@@ -113,25 +134,16 @@ int RequestController::issue_rpc() {
     if(_controller->_timer.timeout()) {
         _error_code = NET_TIMEOUT;
         feedback(NET_TIMEOUT);
-        _controller->giveback_connection(std::move(_connection), true);
-        return NET_TIMEOUT;
-    }
-
-    // add listener
-    int ret = listen();
-    if (ret != NET_SUCC) {
-        _error_code = NET_EPOLL_FAIL;
         unlisten();
         _controller->giveback_connection(std::move(_connection), true);
-        return retry(_error_code);
+        return NET_TIMEOUT;
     }
     return NET_SUCC;
 }
 
 int RequestController::listen() {
     if (_connection) {
-        EventDispatcher& dispatcher = get_event_dispatcher(_connection->get_fd());
-        return dispatcher.add_listener(_controller->_id, _connection->get_fd());
+        return _connection->bind_owner(_controller->_id);
     } else {
         return NET_DISCONNECTED;
     }
@@ -139,8 +151,8 @@ int RequestController::listen() {
 
 int RequestController::unlisten() {
     if (_connection) {
-        EventDispatcher& dispatcher = get_event_dispatcher(_connection->get_fd());
-        return dispatcher.remove_listener(_connection->get_fd());
+        _connection->unbind_owner();
+        return NET_SUCC;
     } else {
         return NET_DISCONNECTED;
     }
@@ -155,6 +167,12 @@ int RequestController::retry(int ret_code) {
     } else {
         ++(_controller->_retry_count);
         DEBUG("logid:%s retry %u times.", _controller->_logid.c_str(), _controller->_retry_count);
+        if (_controller->_in_dispatcher) {
+            // connecting and sending may block, request keeps running until retried
+            _retry_deferred = true;
+            _controller->run_outside_dispatcher(&Controller::handle_deferred_retry);
+            return NET_SUCC;
+        }
         return issue_rpc();
     }
 }
@@ -166,6 +184,7 @@ void RequestController::cancel(int code) {
 
     DEBUG("logid:%s cancel request with code: %d", _controller->_logid.c_str(), code);
     _is_running = false;
+    _retry_deferred = false;
     unlisten();
     _controller->giveback_connection(std::move(_connection), true);
     _error_code = code;
@@ -173,27 +192,44 @@ void RequestController::cancel(int code) {
 }
 
 int RequestController::on_epoll_in() {
-    unlisten();
     MillisecondsCountdownTimer::rep_type remain;
     if (_controller->_timer.timeout(&remain)) {
+        unlisten();
         _controller->giveback_connection(std::move(_connection), true);
         _error_code = NET_TIMEOUT;
         feedback(NET_TIMEOUT);
         return NET_TIMEOUT;
     } else {
         int ret = NET_SUCC;
-        TIMER(_feedback_info.read_cost) {
-            ret = _response->read_from(_connection.get(), remain);
+        bool eof = false;
+        uint32_t read_cost = 0;
+        TIMER(read_cost) {
+            if (_response->support_consume()) {
+                ret = consume_response(&eof);
+            } else {
+                ret = _response->read_from(_connection.get(), remain);
+            }
         }
+        // partial response may be read in several epoll events
+        _feedback_info.read_cost += read_cost;
+        if (ret == NET_RECV_PARTIAL) {
+            // wait for the rest of response, socket is drained so next arrival triggers an edge
+            return ret;
+        }
+        unlisten();
         _error_code = ret;
         if (ret == NET_SUCC) {
-            // rpc success
-            _controller->giveback_connection(std::move(_connection), false);
+            // rpc success, connection closed by peer or with unexpected data left
+            // should not be reused, peer close may arrive along with the response
+            bool reusable = !eof && _connection->read_buffer().empty() && !_connection->broken();
+            _controller->giveback_connection(std::move(_connection), !reusable);
             _is_running = false;
             feedback(NET_SUCC);
             DEBUG("logid:%s receive response success.", _controller->_logid.c_str());
             return NET_SUCC;
         } else {
+            // a deferred retry must not match late events of this fd
+            _controller->giveback_connection(std::move(_connection), true);
             feedback(ret);
             DEBUG("logid:%s receive response failed. ret:%d", _controller->_logid.c_str(), ret);
             retry(ret);
@@ -202,6 +238,41 @@ int RequestController::on_epoll_in() {
     }
 }
 
+int RequestController::consume_response(bool* eof) {
+    ReadBuffer& buffer = _connection->read_buffer();
+    *eof = false;
+    while (true) {
+        ssize_t ret = buffer.fill(_connection->get_fd(), eof);
+        if (ret < 0) {
+            return ret;
+        }
+        // buffer not filled up, all available data are read
+        bool drained = *eof || !buffer.full();
+
+        if (!buffer.empty()) {
+            size_t consumed = 0;
+            ParseResult result = _response->consume(buffer.data(), buffer.size(), &consumed);
+            buffer.consume(consumed);
+            if (result == PARSE_DONE) {
+                return NET_SUCC;
+            } else if (result == PARSE_ERROR) {
+                return NET_PARSE_MESSAGE_FAIL;
+            } else if (buffer.full()) {
+                WARNING("logid:%s response parser stalls with full read buffer",
+                        _controller->_logid.c_str());
+                return NET_PARSE_MESSAGE_FAIL;
+            }
+        }
+
+        if (*eof) {
+            // closed by peer before a complete response
+            return NET_RECV_FAIL;
+        } else if (drained) {
+            return NET_RECV_PARTIAL;
+        }
+    }
+}
+
 int RequestController::on_epoll_error() {
     unlisten();
     _controller->giveback_connection(std::move(_connection), true);
@@ -218,24 +289,48 @@ int RequestController::on_epoll_error() {
     }
 }
 
+class Controller::CallbackLock {
+public:
+    explicit CallbackLock(Controller* controller)
+        : _controller(controller), _lock(controller->_mutex) {}
+
+    ~CallbackLock() {
+        // the task holds a reference, controller is not touched after unlocking
+        TaskFunc task;
+        task.swap(_controller->_callback_task);
+        _lock.unlock();
+        if (task) {
+            task();
+        }
+    }
+
+private:
+    Controller* _controller;
+    std::unique_lock<std::mutex> _lock;
+};
+
 Controller::Controller(ChannelPtr&& channel, const RPCOptions& options)
-    : _id(INVALID_CONTROLLER_ID),
+    : _arena(),
+      _id(INVALID_CONTROLLER_ID),
       _options(options),
       _timer(-1),
       _channel(channel),
       _request(nullptr),
       _response(nullptr),
+      _lb_context(&_arena),
       _error_code(NET_UNKNOW_ERROR),
       _cost(0),
       _use_debug_ep(false),
       _status(INIT),
       _retry_count(0),
       _has_backup_request(false),
+      _in_dispatcher(false),
       _submit_task_id(INVALID_TASK_ID),
-      _timeout_task_id(INVALID_TASK_ID),
-      _backup_request_task_id(INVALID_TASK_ID),
       _user_thread_joining(0),
-      _pending_tasks(),
+      _callback_pending(false),
+      _pending_tasks(ArenaAllocator<TaskFunc>(&_arena)),
+      _callback_task(nullptr),
+      _bg_tasks(ArenaAllocator<BackgroundTaskId>(&_arena)),
       _self(nullptr) {
     _request = _channel->make_request();
 }
@@ -254,7 +349,7 @@ Controller::~Controller() {
 }
 
 const std::string& Controller::get_protocol() const {
-    return _channel->_options.protocol;
+    return _channel->_protocol;
 }
 
 int Controller::submit() {
@@ -266,7 +361,7 @@ int Controller::submit(const RPCCallback& callback) {
         return NET_INTERNAL_ERROR;
     }
 
-    std::lock_guard<std::mutex> lock(_mutex);
+    CallbackLock lock(this);
     _submit_task_id = INVALID_TASK_ID;
 
     // check status
@@ -280,18 +375,32 @@ int Controller::submit(const RPCCallback& callback) {
     _status = RUNNING;
     _user_callback = callback;
     _timer.reset(_options.total_timeout_ms);
-    _normal_request.reset(new RequestController(this));
+    if (_id == INVALID_CONTROLLER_ID) {
+        WARNING("logid: %s too many running controllers", _logid.c_str());
+        on_rpc_failed(NET_INTERNAL_ERROR);
+        return NET_INTERNAL_ERROR;
+    }
+    _normal_request.reset(new_request_controller());
+    if (!_normal_request) {
+        on_rpc_failed(NET_INTERNAL_ERROR);
+        return NET_INTERNAL_ERROR;
+    }
     int ret = _normal_request->issue_rpc();
     if (ret != NET_SUCC) {
         on_rpc_failed(_normal_request->error_code());
         return ret;
     }
 
-    // set background timer tasks
+    // set timers on the dispatcher of the connection, weak reference not to extend lifetime
+    EventDispatcher& dispatcher = get_event_dispatcher(_normal_request->dispatcher_index());
+    ControllerWeakPtr weak_this = shared_from_this();
     if (_options.total_timeout_ms >= 0) {
-        _timeout_task_id = add_background_task(
-                std::bind(&Controller::controller_timeout_wrapper, shared_from_this()),
+        _timeout_timer = dispatcher.add_timer(
+                std::bind(&Controller::timer_wrapper, weak_this, &Controller::handle_rpc_timeout),
                 _timer.remain());
+        if (!_timeout_timer) {
+            WARNING("logid: %s add timeout timer failed", _logid.c_str());
+        }
     }
     if (_options.backup_request_timeout_ms > 0) {
         int32_t delay_time = _options.backup_request_timeout_ms;
@@ -301,9 +410,13 @@ int Controller::submit(const RPCCallback& callback) {
         }
 
         delay_time -= _timer.tick();
-        _backup_request_task_id = add_background_task(
-                std::bind(&Controller::backup_request_wrapper, shared_from_this()),
+        _backup_request_timer = dispatcher.add_timer(
+                std::bind(&Controller::timer_wrapper, weak_this,
+                        &Controller::handle_backup_request),
                 std::max(0, delay_time));
+        if (!_backup_request_timer) {
+            WARNING("logid: %s add backup request timer failed", _logid.c_str());
+        }
     }
     return ret;
 }
@@ -320,7 +433,7 @@ int Controller::submit_async() {
 }
 
 int Controller::submit_async(const RPCCallback& callback) {
-    std::lock_guard<std::mutex> lock(_mutex);
+    CallbackLock lock(this);
     if (_status != INIT) {
         return NET_INVALID_ARGUMENT;
     }
@@ -358,9 +471,24 @@ void Controller::giveback_connection(ConnectionPtr&& connection, bool close) {
     _channel->giveback_connection(std::move(connection), close);
 }
 
+bool Controller::run_in_dispatcher() const {
+    if (!_options.run_in_dispatcher) {
+        return false;
+    }
+    // all requests of a controller share the protocol
+    const RequestControllerPtr& request = _normal_request ? _normal_request : _backup_request;
+    return request && request->_response != nullptr && request->_response->support_consume();
+}
+
 void Controller::on_epoll_in(int fd) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if (_user_thread_joining > 0) {
+    CallbackLock lock(this);
+    if (run_in_dispatcher()) {
+        // run to completion in event dispatcher thread
+        DEBUG("logid: %s on_epoll_in in event dispatcher thread", _logid.c_str());
+        _in_dispatcher = true;
+        handle_epoll_in(fd);
+        _in_dispatcher = false;
+    } else if (_user_thread_joining > 0) {
         // running in user thread
         DEBUG("logid: %s on_epoll_in in user thread", _logid.c_str());
         _pending_tasks.emplace_back(std::bind(
@@ -376,12 +504,18 @@ void Controller::on_epoll_in(int fd) {
 }
 
 void Controller::on_epoll_error(int fd) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    if (_user_thread_joining > 0) {
+    CallbackLock lock(this);
+    if (run_in_dispatcher()) {
+        // run to completion in event dispatcher thread
+        DEBUG("logid: %s on_epoll_error in event dispatcher thread", _logid.c_str());
+        _in_dispatcher = true;
+        handle_epoll_error(fd);
+        _in_dispatcher = false;
+    } else if (_user_thread_joining > 0) {
         // running in user thread
         DEBUG("logid: %s on_epoll_error in user thread", _logid.c_str());
         _pending_tasks.emplace_back(std::bind(
-                &Controller::handle_epoll_in, this, fd));
+                &Controller::handle_epoll_error, this, fd));
         _cond.notify_one();
     } else {
         // running in back ground threads
@@ -395,14 +529,14 @@ void Controller::on_epoll_error(int fd) {
 void Controller::epoll_in_wrapper(ControllerWeakPtr controller, int fd) {
     ControllerPtr lock_controller = controller.lock();
     if (lock_controller) {
-        std::lock_guard<std::mutex> lock(lock_controller->_mutex);
+        CallbackLock lock(lock_controller.get());
         lock_controller->handle_epoll_in(fd);
     }
 }
 void Controller::epoll_error_wrapper(ControllerWeakPtr controller, int fd) {
     ControllerPtr lock_controller = controller.lock();
     if (lock_controller) {
-        std::lock_guard<std::mutex> lock(lock_controller->_mutex);
+        CallbackLock lock(lock_controller.get());
         lock_controller->handle_epoll_error(fd);
     }
 }
@@ -431,7 +565,7 @@ void Controller::handle_epoll_in(int fd) {
             }
             on_rpc_success();
         } else {
-            // read response failed
+            // read response failed, or response partially received and request still running
             if (!normal_request_running() && !backup_request_running()) {
                 on_rpc_failed(_normal_request->error_code());
             }
@@ -449,16 +583,14 @@ void Controller::handle_epoll_in(int fd) {
             }
             on_rpc_success();
         } else {
-            // read response failed
+            // read response failed, or response partially received and request still running
             if (!normal_request_running() && !backup_request_running()) {
                 on_rpc_failed(_backup_request->error_code());
             }
         }
     } else {
-        // unknow fd, remove listener and ignore
-        WARNING("logid: %s handle_epoll_in for unknow fd:%d", _logid.c_str(), fd);
-        EventDispatcher& dispatcher = get_event_dispatcher(fd);
-        dispatcher.remove_listener(fd);
+        // late event of a connection already given back, ignore
+        DEBUG("logid: %s handle_epoll_in for unknow fd:%d", _logid.c_str(), fd);
     }
 }
 
@@ -483,10 +615,8 @@ void Controller::handle_epoll_error(int fd) {
         _backup_request->on_epoll_error();
         err_code = _backup_request->error_code();
     } else {
-        // unknow fd, remove listener and ignore
-        WARNING("logid: %s handle_epoll_error for unknow fd:%d", _logid.c_str(), fd);
-        EventDispatcher& dispatcher = get_event_dispatcher(fd);
-        dispatcher.remove_listener(fd);
+        // late event of a connection already given back, ignore
+        DEBUG("logid: %s handle_epoll_error for unknow fd:%d", _logid.c_str(), fd);
         return;
     }
 
@@ -498,8 +628,8 @@ void Controller::handle_epoll_error(int fd) {
 void Controller::cleanup() {
     ControllerAddresser::remove(_id);
     cancel_bg_task(_submit_task_id);
-    cancel_bg_task(_backup_request_task_id);
-    cancel_bg_task(_timeout_task_id);
+    cancel_timer(_backup_request_timer);
+    cancel_timer(_timeout_timer);
     cancel_pending_bg_tasks();
 }
 
@@ -512,9 +642,7 @@ void Controller::on_rpc_success() {
     _error_code = NET_SUCC;
     cleanup();
     DEBUG("logid:%s controller success, retry_count:%u", _logid.c_str(), _retry_count);
-    if (_user_callback) {
-        _user_callback(shared_from_this(), _request, _response);
-    }
+    run_user_callback(_response);
     _self.reset();
     _cond.notify_all();
 }
@@ -539,9 +667,7 @@ void Controller::on_rpc_timeout() {
         _normal_request.reset();
     }
     DEBUG("logid:%s controller timeout, retry_count:%u", _logid.c_str(), _retry_count);
-    if (_user_callback) {
-        _user_callback(shared_from_this(), _request, nullptr);
-    }
+    run_user_callback(nullptr);
     _self.reset();
     _cond.notify_all();
 }
@@ -561,9 +687,7 @@ void Controller::on_rpc_failed(int error_code) {
     _normal_request.reset();
     DEBUG("logid:%s controller failed, error_code:%d, retry_count:%u",
             _logid.c_str(), error_code, _retry_count);
-    if (_user_callback) {
-        _user_callback(shared_from_this(), _request, nullptr);
-    }
+    run_user_callback(nullptr);
     _self.reset();
     _cond.notify_all();
 }
@@ -582,45 +706,95 @@ void Controller::on_rpc_canceled(bool run_callback) {
     _backup_request.reset();
 
     // run user callback
-    if (run_callback && _user_callback) {
-        _user_callback(shared_from_this(), _request, nullptr);
+    if (run_callback) {
+        run_user_callback(nullptr);
     }
     _self.reset();
     // wake up user thread
     _cond.notify_all();
 }
 
-void Controller::controller_timeout_wrapper(ControllerWeakPtr controller) {
+void Controller::run_user_callback(IResponse* response) {
+    if (!_user_callback) {
+        return;
+    }
+    if (_options.callback_executor) {
+        // _mutex is held here, hand over after unlocking, see CallbackLock
+        _callback_pending = true;
+        _callback_task = std::bind(_options.callback_executor, TaskFunc(std::bind(
+                &Controller::user_callback_wrapper, shared_from_this(), response)));
+    } else {
+        _user_callback(shared_from_this(), _request, response);
+    }
+}
+
+void Controller::user_callback_wrapper(ControllerPtr controller, IResponse* response) {
+    controller->_user_callback(controller, controller->_request, response);
+    std::lock_guard<std::mutex> lock(controller->_mutex);
+    controller->_callback_pending = false;
+    controller->_cond.notify_all();
+}
+
+void Controller::timer_wrapper(ControllerWeakPtr controller, TimerHandler handler) {
     ControllerPtr lock_controller = controller.lock();
     if (lock_controller) {
-        lock_controller->handle_rpc_timeout();
+        CallbackLock lock(lock_controller.get());
+        lock_controller->on_timer(handler);
     }
 }
 
-void Controller::backup_request_wrapper(ControllerWeakPtr controller) {
+void Controller::handler_wrapper(ControllerWeakPtr controller, TimerHandler handler) {
     ControllerPtr lock_controller = controller.lock();
     if (lock_controller) {
-        lock_controller->handle_backup_request();
+        CallbackLock lock(lock_controller.get());
+        (lock_controller.get()->*handler)();
+    }
+}
+
+void Controller::on_timer(TimerHandler handler) {
+    if (_status != RUNNING) {
+        return;
+    }
+    // issuing backup request connects and sends blocking
+    if (run_in_dispatcher() && handler != &Controller::handle_backup_request) {
+        // run in event dispatcher thread
+        (this->*handler)();
+    } else {
+        run_outside_dispatcher(handler);
+    }
+}
+
+void Controller::run_outside_dispatcher(TimerHandler handler) {
+    if (_user_thread_joining > 0) {
+        // running in user thread
+        _pending_tasks.emplace_back(std::bind(handler, this));
+        _cond.notify_one();
+    } else {
+        // issuing request or running user callback may block, run in back ground threads
+        BackgroundTaskId task_id = add_background_task(std::bind(
+                &Controller::handler_wrapper, shared_from_this(), handler));
+        _bg_tasks.push_back(task_id);
     }
 }
 
 void Controller::handle_rpc_timeout() {
-    std::lock_guard<std::mutex> lock(_mutex);
     if (_status != RUNNING) {
         return;
     }
-    _timeout_task_id = INVALID_TASK_ID;
+    _timeout_timer.reset();
     on_rpc_timeout();
 }
 
 void Controller::handle_backup_request() {
-    std::lock_guard<std::mutex> lock(_mutex);
     DEBUG("start backup request...");
-    _backup_request_task_id = INVALID_TASK_ID;
+    _backup_request_timer.reset();
     if (_status == RUNNING) {
         if (check_need_retry()) {
+            _backup_request.reset(new_request_controller());
+            if (!_backup_request) {
+                return;
+            }
             ++_retry_count;
-            _backup_request.reset(new RequestController(this));
             int ret = _backup_request->issue_rpc();
             if (ret == NET_SUCC) {
                 _has_backup_request = true;
@@ -632,24 +806,51 @@ void Controller::handle_backup_request() {
     }
 }
 
+void Controller::handle_deferred_retry() {
+    if (_status != RUNNING) {
+        return;
+    }
+    int err_code = NET_SUCC;
+    RequestController* requests[] = {_normal_request.get(), _backup_request.get()};
+    for (RequestController* request : requests) {
+        if (request != nullptr && request->is_running() && request->_retry_deferred) {
+            request->_retry_deferred = false;
+            if (request->issue_rpc() != NET_SUCC) {
+                err_code = request->error_code();
+            }
+        }
+    }
+    if (err_code != NET_SUCC && !normal_request_running() && !backup_request_running()) {
+        on_rpc_failed(err_code);
+    }
+}
+
 int Controller::join() {
     std::unique_lock<std::mutex> lock(_mutex);
     if (_status == INIT) {
         return NET_INVALID_ARGUMENT;
-    } else if (_status != RUNNING && _status != SUBMITING) {
+    } else if (_status != RUNNING && _status != SUBMITING && !_callback_pending) {
         return status_2_ret_code(_status);
     } else {
         ++_user_thread_joining;
-        // rpc RUNNING, wait until rpc end
-        while (_status == RUNNING || _status == SUBMITING) {
+        // rpc RUNNING, wait until rpc end and user callback done
+        while (_status == RUNNING || _status == SUBMITING || _callback_pending) {
             // running tasks in user thread
             while (!_pending_tasks.empty()) {
                 // copy task, to avoid clearing _pending_tasks by task itself
                 TaskFunc task = _pending_tasks.front();
                 _pending_tasks.pop_front();
                 task();
+                if (_callback_task) {
+                    // hand user callback to callback_executor with _mutex released
+                    TaskFunc callback_task;
+                    callback_task.swap(_callback_task);
+                    lock.unlock();
+                    callback_task();
+                    lock.lock();
+                }
             }
-            if (_status == RUNNING || _status == SUBMITING) {
+            if (_status == RUNNING || _status == SUBMITING || _callback_pending) {
                 _cond.wait_for(lock, Milliseconds(_options.total_timeout_ms));
             }
         }
@@ -673,7 +874,7 @@ int Controller::detach() {
 }
 
 void Controller::cancel(bool run_callback) {
-    std::lock_guard<std::mutex> lock(_mutex);
+    CallbackLock lock(this);
     if (_status == INIT || _status == SUBMITING) {
         _self.reset();
         cancel_bg_task(_submit_task_id);
@@ -686,6 +887,11 @@ void Controller::cancel(bool run_callback) {
     }
 }
 
+RequestController* Controller::new_request_controller() {
+    void* p = _arena.allocate(sizeof(RequestController), alignof(RequestController));
+    return p == nullptr ? nullptr : new (p) RequestController(this);
+}
+
 void Controller::cancel_pending_bg_tasks() {
     for (auto& id : _bg_tasks) {
         cancel_bg_task(id);
@@ -727,7 +933,7 @@ void cancel_rpc(ControllerId id, bool run_callback) {
     }
 }
  
-ControllerAddresser::ControllerAddresser() : _cur_id(0) {}
+ControllerAddresser::ControllerAddresser() {}
  
 ControllerAddresser::~ControllerAddresser() {}
  
@@ -741,25 +947,21 @@ ControllerId ControllerAddresser::regist_internal(ControllerWeakPtr instance) {
         return INVALID_CONTROLLER_ID;
     }
 
-    std::lock_guard<std::mutex> lock(_mutex);
-    ControllerId id = ++(_cur_id);
-    if (id == INVALID_CONTROLLER_ID) {
-        // ֹ0
-        id = ++(_cur_id);
-    }
-    _id_2_instance_map[id] = std::move(instance);
-    return id;
+    // INVALID_CONTROLLER_ID if all slots are in use
+    return _instances.insert(instance);
 }
 
 void ControllerAddresser::remove_internal(ControllerId id) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    _id_2_instance_map.erase(id);
+    _instances.erase(id);
 }
 
 ControllerWeakPtr ControllerAddresser::address_internal(ControllerId id) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    auto iter = _id_2_instance_map.find(id);
-    return iter == _id_2_instance_map.end() ? ControllerWeakPtr() : iter->second;
+    // stale id is rejected by version
+    ControllerWeakPtr instance;
+    _instances.visit(id, [&instance] (ControllerWeakPtr& value) {
+        instance = value;
+    });
+    return instance;
 }
  
 } // end namespace wrpc
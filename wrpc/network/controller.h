@@ -13,15 +13,17 @@
 #include <deque>
 #include <functional>
 #include <mutex>
-#include <unordered_map>
 
 #include "common/options.h"
 #include "common/rpc_feedback.h"
 #include "interface/load_balancer.h"
 #include "interface/message.h"
+#include "network/event_dispatcher.h"
 #include "network/network_common.h"
+#include "utils/arena.h"
 #include "utils/background.h"
 #include "utils/common_define.h"
+#include "utils/slot_map.h"
 #include "utils/timer.h"
  
 namespace wrpc {
@@ -30,8 +32,6 @@ typedef std::function<void (ControllerPtr, IRequest*, IResponse*)> RPCCallback;
 
 static const ControllerId INVALID_CONTROLLER_ID = 0;
 
-class EventDispatcher;
-
 enum ControllerStatus {
     CANCELED = -3,
     TIMEOUT = -2,
@@ -48,7 +48,7 @@ enum ControllerStatus {
 class RequestController {
 private:
     friend class Controller;
-    friend class std::default_delete<RequestController>;
+    friend struct ArenaDeleter<RequestController>;
 
     explicit RequestController(Controller*);
     ~RequestController();
@@ -61,6 +61,9 @@ private:
 public:
     int get_fd() const;
 
+    // event dispatcher of current connection
+    uint32_t dispatcher_index() const;
+
     int error_code() const {
         return _error_code;
     }
@@ -86,11 +89,16 @@ public:
     void feedback(int code);
 
 private:
+    // /ӵowner, ӳעepoll
     int listen();
     int unlisten();
+    // eof: Զڷݺر, Ӳٸ
+    int consume_response(bool* eof);
 
 private:
     bool _is_running;
+    // ڷַ߳Ҫ, Ƴٵַ߳ⷢ, Controller::handle_deferred_retry
+    bool _retry_deferred;
     Controller* _controller;
     ConnectionPtr _connection;
     IResponse* _response;
@@ -254,8 +262,12 @@ private:
     static void submit_wrapper(ControllerWeakPtr controller, const RPCCallback& callback);
     static void epoll_in_wrapper(ControllerWeakPtr controller, int fd);
     static void epoll_error_wrapper(ControllerWeakPtr controller, int fd);
-    static void controller_timeout_wrapper(ControllerWeakPtr controller);
-    static void backup_request_wrapper(ControllerWeakPtr controller);
+    typedef void (Controller::*TimerHandler)();
+    // ַʱ, on_timerѡִ߳
+    static void timer_wrapper(ControllerWeakPtr controller, TimerHandler handler);
+    // ںֱִ̨߳handler
+    static void handler_wrapper(ControllerWeakPtr controller, TimerHandler handler);
+    static void user_callback_wrapper(ControllerPtr controller, IResponse* response);
 
     void on_epoll_in(int fd);
     void on_epoll_error(int fd);
@@ -269,8 +281,16 @@ private:
     bool check_need_retry() {
         return _retry_count < _options.max_retry_num && !_timer.timeout();
     }
+    // ʱڷַ߳д, ִ߳ͬon_epoll_in, backup request, ڷִַ߳
+    void on_timer(TimerHandler handler);
     void handle_rpc_timeout();
     void handle_backup_request();
+    // Ӧ(support_consume)ʱ, run_in_dispatcherЧ
+    bool run_in_dispatcher() const;
+    // û߳joinʱûִ߳, 򽻸̨߳
+    void run_outside_dispatcher(TimerHandler handler);
+    // ڷַ߳Ƴٵ, Ӻͷ
+    void handle_deferred_retry();
     void cleanup();
 
     // ״̬仯
@@ -278,6 +298,10 @@ private:
     void on_rpc_timeout();
     void on_rpc_failed(int error_code);
     void on_rpc_canceled(bool run_callback = true);
+    void run_user_callback(IResponse* response);
+    // _mutex, ٰڼ¼ûصcallback_executor
+    // executorֱڵǰִ߳лصʱ
+    class CallbackLock;
 
     bool normal_request_running() const {
         return _normal_request && _normal_request->is_running();
@@ -287,7 +311,12 @@ private:
     }
     void cancel_pending_bg_tasks();
 
+    // RequestController in arena
+    RequestController* new_request_controller();
+
 private:
+    // objects of this rpc, must be declared before members using it
+    Arena _arena;
     ControllerId _id;
     RPCOptions _options;
     std::string _logid;
@@ -308,20 +337,28 @@ private:
     ControllerStatus _status;
     uint32_t _retry_count;
     bool _has_backup_request;
-    std::unique_ptr<RequestController> _normal_request;
-    std::unique_ptr<RequestController> _backup_request;
+    // ڷַ߳д¼, ʱƳٵַ߳
+    bool _in_dispatcher;
+    typedef std::unique_ptr<RequestController, ArenaDeleter<RequestController> > RequestControllerPtr;
+    RequestControllerPtr _normal_request;
+    RequestControllerPtr _backup_request;
 
     // back ground task
     BackgroundTaskId _submit_task_id;
-    BackgroundTaskId _timeout_task_id;
-    BackgroundTaskId _backup_request_task_id;
+    // ܳʱbackup requestʱ, ڵķַ
+    DispatcherTimerPtr _timeout_timer;
+    DispatcherTimerPtr _backup_request_timer;
 
     uint32_t _user_thread_joining;
+    // ûصѽcallback_executorδִ, joinȴ
+    bool _callback_pending;
     std::mutex _mutex;  // mutex
     std::condition_variable _cond; // cond
     typedef std::function<void()> TaskFunc;
-    std::deque<TaskFunc> _pending_tasks;
-    std::deque<BackgroundTaskId> _bg_tasks;
+    std::deque<TaskFunc, ArenaAllocator<TaskFunc> > _pending_tasks;
+    // ʱ¼callback_executor, ִ
+    TaskFunc _callback_task;
+    std::deque<BackgroundTaskId, ArenaAllocator<BackgroundTaskId> > _bg_tasks;
 
     // detachģʽ, , ֹController
     ControllerPtr _self;
@@ -394,9 +431,8 @@ private:
     ControllerWeakPtr address_internal(ControllerId id);
 
 private:
-    std::mutex _mutex;
-    ControllerId _cur_id;
-    std::unordered_map<ControllerId, ControllerWeakPtr> _id_2_instance_map;
+    // idslot±Ͱ汾, Ҳ
+    VersionedSlotMap<ControllerWeakPtr> _instances;
 };
  
 } // end namespace wrpc
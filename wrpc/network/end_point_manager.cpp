@@ -15,8 +15,9 @@
  
 namespace wrpc {
 
-static ConnectionPtr new_connection(const EndPoint& end_point, int32_t timeout_ms) {
-    ConnectionPtr connection(new Connection(end_point));
+static ConnectionPtr new_connection(const EndPoint& end_point, IOBackend io_backend,
+        uint32_t busy_poll_us, int32_t timeout_ms) {
+    ConnectionPtr connection(new Connection(end_point, io_backend, busy_poll_us));
     int ret = connection->connect(timeout_ms);
     if (ret != NET_SUCC) {
         connection.reset();
@@ -24,9 +25,11 @@ static ConnectionPtr new_connection(const EndPoint& end_point, int32_t timeout_m
     return std::move(connection);
 }
 
-void EndPointManager::EndPointWrapper::create_connect_pool(size_t max_size) {
+void EndPointManager::EndPointWrapper::create_connect_pool(size_t max_size, IOBackend io_backend,
+        uint32_t busy_poll_us) {
     if (!conn_pool) {
-        conn_pool.reset(new ConnectionPool(std::bind(new_connection, end_point, std::placeholders::_1), max_size));
+        conn_pool.reset(new ConnectionPool(std::bind(new_connection, end_point, io_backend,
+                busy_poll_us, std::placeholders::_1), max_size));
     }
 }
 
@@ -39,7 +42,8 @@ void EndPointManager::EndPointWrapper::set_alive() {
 }
  
 EndPointManager::EndPointManager()
-    : _connection_type(SHORT), _max_error_count(-1), _conn_pool_max_size(1) {}
+    : _connection_type(SHORT), _io_backend(IO_BACKEND_POLL),
+      _busy_poll_us(0), _max_error_count(-1), _conn_pool_max_size(1) {}
  
 EndPointManager::~EndPointManager() {}
  
@@ -102,7 +106,7 @@ void EndPointManager::health_check(int32_t connect_timeout_ms) {
     // check without lock to avoid blocking
     for (const EndPoint& dead_end_point : dead_end_points) {
         ConnectionPtr connection(
-                new_connection(dead_end_point, connect_timeout_ms));
+                new_connection(dead_end_point, _io_backend, _busy_poll_us, connect_timeout_ms));
         if (connection) {
             // connection success, add to alive end point
             alive_end_points.push_back(dead_end_point);
@@ -124,6 +128,27 @@ void EndPointManager::health_check(int32_t connect_timeout_ms) {
     }
 }
 
+void EndPointManager::add_watcher_with_end_points(IEndPointWatcher* watcher) {
+    if (watcher == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    EndPointList alive_end_points;
+    for (const auto &pair : _end_points) {
+        if (pair.second.status == NORMAL) {
+            alive_end_points.insert(pair.first);
+        }
+    }
+    watcher->on_update_all(alive_end_points);
+    add_watcher(watcher);
+}
+
+void EndPointManager::update_options(int32_t max_error_count, size_t conn_pool_capacity) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _max_error_count = max_error_count;
+    _conn_pool_max_size = conn_pool_capacity;
+}
+
 ConnectionPtr EndPointManager::fetch_connection(const EndPoint& end_point, int32_t timeout_ms) {
     ConnectionPtr connection;
     bool set_death = false;
@@ -133,7 +158,7 @@ ConnectionPtr EndPointManager::fetch_connection(const EndPoint& end_point, int32
         auto iter = _end_points.find(end_point);
         if (iter == _end_points.end()) {
             // end point not found, just try to connect
-            return new_connection(end_point, timeout_ms);
+            return new_connection(end_point, _io_backend, _busy_poll_us, timeout_ms);
         }
 
         EndPointWrapper& wrapper = iter->second;
@@ -145,7 +170,7 @@ ConnectionPtr EndPointManager::fetch_connection(const EndPoint& end_point, int32
         if (wrapper.conn_pool) {
             connection = wrapper.conn_pool->fetch(timeout_ms);
         } else {
-            connection = new_connection(end_point, timeout_ms);
+            connection = new_connection(end_point, _io_backend, _busy_poll_us, timeout_ms);
         }
 
         if (!connection) {
@@ -163,7 +188,7 @@ ConnectionPtr EndPointManager::fetch_connection(const EndPoint& end_point, int32
                 _dead_end_points.erase(end_point);
                 wrapper.set_alive();
                 if (_connection_type == POOLED) {
-                    wrapper.create_connect_pool(_conn_pool_max_size);
+                    wrapper.create_connect_pool(_conn_pool_max_size, _io_backend, _busy_poll_us);
                 }
                 set_alive = true;
             }
@@ -215,7 +240,8 @@ bool EndPointManager::add_endpoint(const EndPoint& end_point) {
     // will not set alive if end point exists and has been set death
     auto insert_ret = _end_points.emplace(end_point, EndPointWrapper(end_point));
     if (insert_ret.second && _connection_type == POOLED) {
-        insert_ret.first->second.create_connect_pool(_conn_pool_max_size);
+        insert_ret.first->second.create_connect_pool(
+                _conn_pool_max_size, _io_backend, _busy_poll_us);
     }
     return insert_ret.second;
 }
@@ -239,7 +265,7 @@ void EndPointManager::set_endpoint_alive(const EndPoint& end_point) {
     if (iter != _end_points.end()) {
         iter->second.set_alive();
         if (_connection_type == POOLED) {
-            iter->second.create_connect_pool(_conn_pool_max_size);
+            iter->second.create_connect_pool(_conn_pool_max_size, _io_backend, _busy_poll_us);
         }
     }
 }
@@ -40,6 +40,14 @@ public:
 
     void health_check(int32_t connect_timeout_ms = WRPC_CONNECT_TIMEOUT_FOR_HEALTH_CHECK);
 
+    // add watcher and initialize it with alive end points
+    // updates after initializing are notified, duplicated ones may be seen
+    void add_watcher_with_end_points(IEndPointWatcher* watcher);
+
+    // update at runtime, existing connection pools are kept
+    // new pool capacity applies to pools created later
+    void update_options(int32_t max_error_count, size_t conn_pool_capacity);
+
     void set_connection_type(ConnectionType type) {
         _connection_type = type;
     }
@@ -56,6 +64,22 @@ public:
         return _max_error_count;
     }
 
+    void set_io_backend(IOBackend io_backend) {
+        _io_backend = io_backend;
+    }
+
+    IOBackend get_io_backend() const {
+        return _io_backend;
+    }
+
+    void set_socket_busy_poll(uint32_t busy_poll_us) {
+        _busy_poll_us = busy_poll_us;
+    }
+
+    uint32_t get_socket_busy_poll() const {
+        return _busy_poll_us;
+    }
+
     void set_connect_pool_capacity(size_t conn_pool_capacity) {
         _conn_pool_max_size = conn_pool_capacity;
     }
@@ -84,7 +108,7 @@ private:
         ~EndPointWrapper() {}
 
         void release_connect_pool() { conn_pool.reset(); }
-        void create_connect_pool(size_t max_size);
+        void create_connect_pool(size_t max_size, IOBackend io_backend, uint32_t busy_poll_us);
         void set_death();
         void set_alive();
     };
@@ -103,6 +127,8 @@ private:
 private:
     // options
     ConnectionType _connection_type;
+    IOBackend _io_backend;
+    uint32_t _busy_poll_us;
     int32_t _max_error_count;
     size_t _conn_pool_max_size;
 
@@ -9,29 +9,73 @@
 #include "network/event_dispatcher.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include <mutex>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
 
+#include "network/connection.h"
 #include "network/controller.h"
 #include "utils/common_flags.h"
 #include "utils/write_log.h"
  
 namespace wrpc {
 
-EventDispatcher::EventDispatcher() : _epoll_fd(-1), _stop(false), _is_running(false) {
+// connection ids are never 0, use it for the wakeup eventfd
+static const ConnectionId WAKEUP_EVENT_ID = INVALID_CONNECTION_ID;
+
+// compact timer heap only when it is large enough
+static const size_t TIMER_COMPACT_THRESHOLD = 1024;
+
+static inline int64_t monotonic_micro() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// earlier deadline on top
+static inline bool timer_later(const DispatcherTimerPtr& a, const DispatcherTimerPtr& b) {
+    return a->deadline_us() > b->deadline_us();
+}
+
+bool DispatcherTimer::cancel() {
+    if (_expired.exchange(true)) {
+        return false;
+    }
+    _dispatcher->_canceled_timers.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+EventDispatcher::EventDispatcher()
+    : _epoll_fd(-1),
+      _event_size(WRPC_EVENT_DISPATCHER_EVENT_SIZE),
+      _cpu(-1),
+      _busy_poll_us(0),
+      _stop(false),
+      _is_running(false),
+      _dispatch_thread_id(std::thread::id()),
+      _wakeup_fd(-1),
+      _wakeup_pending(false),
+      _canceled_timers(0) {
 }
 
 EventDispatcher::~EventDispatcher() {
     stop(true);
 }
 
-int EventDispatcher::start() {
+int EventDispatcher::start(uint32_t event_size, int cpu) {
     if (_dispatch_thread) {
         WARNING("EventDispatcher is running already");
         return -1;
     }
+    _event_size = event_size > 0 ? event_size : 1;
+    _cpu = cpu;
 
     _epoll_fd = epoll_create(1024 * 1024);
     if (_epoll_fd < 0) {
@@ -39,13 +83,20 @@ int EventDispatcher::start() {
         return _epoll_fd;
     }
 
-    _wakeup_fds[0] = -1;
-    _wakeup_fds[1] = -1;
-    int ret = pipe(_wakeup_fds);
+    _wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeup_fd < 0) {
+        FATAL("Fail to create eventfd, errno: %d", errno);
+        release_fd();
+        return -1;
+    }
+    // level triggered, stays readable until drained by dispatcher
+    epoll_event evt;
+    evt.events = EPOLLIN;
+    evt.data.u64 = WAKEUP_EVENT_ID;
+    int ret = epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wakeup_fd, &evt);
     if (ret != 0) {
-        FATAL("Fail to create pipe, ret: %d", ret);
-        close(_epoll_fd);
-        _epoll_fd = -1;
+        FATAL("Fail to listen eventfd, errno: %d", errno);
+        release_fd();
         return ret;
     }
 
@@ -61,9 +112,11 @@ void EventDispatcher::stop(bool wait) {
     _stop.store(true);
 
     // wakeup epoll wait
-    if (_epoll_fd >= 0) {
-        epoll_event evt = { EPOLLOUT,  { NULL } };
-        epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wakeup_fds[1], &evt);
+    if (_wakeup_fd >= 0) {
+        _wakeup_pending.store(true);
+        uint64_t one = 1;
+        ssize_t ret = write(_wakeup_fd, &one, sizeof(one));
+        (void) ret;
     }
 
     if (wait) {
@@ -83,8 +136,8 @@ void EventDispatcher::join() {
     }
 }
 
-int EventDispatcher::add_listener(ControllerId cid, int fd) {
-    if (cid == INVALID_CONTROLLER_ID || fd < 0) {
+int EventDispatcher::add_listener(ConnectionId id, int fd) {
+    if (id == INVALID_CONNECTION_ID || fd < 0) {
         return -1;
     }
     if (_epoll_fd < 0) {
@@ -92,14 +145,111 @@ int EventDispatcher::add_listener(ControllerId cid, int fd) {
         return -1;
     }
     epoll_event evt;
-    evt.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
-    ListenerData *data = (ListenerData *) (&evt.data.u64);
-    data->cid = cid;
-    data->fd = fd;
-    DEBUG("event dispacher add controller:%lu, fd:%d", cid, fd);
+    evt.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    evt.data.u64 = id;
+    DEBUG("event dispacher add connection:%lu, fd:%d", id, fd);
     return epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &evt);
 }
 
+int EventDispatcher::post(DispatcherTask&& task) {
+    if (!task || !is_running()) {
+        return -1;
+    }
+    _tasks.push(std::move(task));
+    // push is completed before wakeup flag is checked, so dispatcher clearing the flag sees it
+    if (!_wakeup_pending.exchange(true)) {
+        wakeup();
+    }
+    return 0;
+}
+
+bool EventDispatcher::in_dispatcher_thread() const {
+    return std::this_thread::get_id() == _dispatch_thread_id.load(std::memory_order_acquire);
+}
+
+void EventDispatcher::wakeup() {
+    uint64_t one = 1;
+    while (write(_wakeup_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+void EventDispatcher::run_posted_tasks() {
+    uint64_t count = 0;
+    while (read(_wakeup_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+    // clear flag before draining, tasks pushed after this will wakeup again
+    _wakeup_pending.store(false);
+    DispatcherTask task;
+    while (_tasks.pop(&task)) {
+        task();
+        task = nullptr;
+    }
+}
+
+DispatcherTimerPtr EventDispatcher::add_timer(DispatcherTask&& task, int64_t delay_ms) {
+    if (!task || !is_running()) {
+        return DispatcherTimerPtr();
+    }
+    int64_t deadline_us = monotonic_micro() + std::max<int64_t>(delay_ms, 0) * 1000;
+    DispatcherTimerPtr timer = std::make_shared<DispatcherTimer>(this, std::move(task), deadline_us);
+    if (in_dispatcher_thread()) {
+        // epoll_wait timeout is recalculated before next wait
+        insert_timer(timer);
+    } else if (post([this, timer] () { insert_timer(timer); }) != 0) {
+        return DispatcherTimerPtr();
+    }
+    return timer;
+}
+
+void EventDispatcher::insert_timer(const DispatcherTimerPtr& timer) {
+    _timers.push_back(timer);
+    std::push_heap(_timers.begin(), _timers.end(), timer_later);
+}
+
+int EventDispatcher::next_timer_timeout() {
+    while (!_timers.empty() && _timers.front()->_expired.load(std::memory_order_relaxed)) {
+        // canceled
+        std::pop_heap(_timers.begin(), _timers.end(), timer_later);
+        _timers.pop_back();
+        _canceled_timers.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (_timers.empty()) {
+        return -1;
+    }
+    int64_t remain_us = _timers.front()->_deadline_us - monotonic_micro();
+    // round up, so that the top timer is expired when woken up by timeout
+    return remain_us <= 0 ? 0 : static_cast<int>((remain_us + 999) / 1000);
+}
+
+void EventDispatcher::run_expired_timers() {
+    int64_t now = monotonic_micro();
+    while (!_timers.empty() && _timers.front()->_deadline_us <= now) {
+        std::pop_heap(_timers.begin(), _timers.end(), timer_later);
+        DispatcherTimerPtr timer = std::move(_timers.back());
+        _timers.pop_back();
+        if (timer->_expired.exchange(true)) {
+            // canceled
+            _canceled_timers.fetch_sub(1, std::memory_order_relaxed);
+        } else {
+            timer->_task();
+        }
+        // release resources bound to task
+        timer->_task = nullptr;
+    }
+
+    size_t canceled = _canceled_timers.load(std::memory_order_relaxed);
+    if (_timers.size() > TIMER_COMPACT_THRESHOLD && canceled * 2 > _timers.size()) {
+        size_t size = _timers.size();
+        _timers.erase(std::remove_if(_timers.begin(), _timers.end(),
+                [] (const DispatcherTimerPtr& timer) {
+                    return timer->_expired.load(std::memory_order_relaxed);
+                }), _timers.end());
+        std::make_heap(_timers.begin(), _timers.end(), timer_later);
+        _canceled_timers.fetch_sub(size - _timers.size(), std::memory_order_relaxed);
+        DEBUG("compact timers from %lu to %lu", size, _timers.size());
+    }
+}
+
 int EventDispatcher::remove_listener(int fd) {
     if (fd < 0) {
         return -1;
@@ -117,29 +267,31 @@ void EventDispatcher::release_fd() {
         close(_epoll_fd);
         _epoll_fd = -1;
     }
-    if (_wakeup_fds[0] > 0) {
-        close(_wakeup_fds[0]);
-        close(_wakeup_fds[1]);
-        _wakeup_fds[0] = -1;
-        _wakeup_fds[1] = -1;
+    if (_wakeup_fd >= 0) {
+        close(_wakeup_fd);
+        _wakeup_fd = -1;
     }
 }
 
 void EventDispatcher::thread_run_wrapper() {
+    // set before any posted task runs, tasks may check in_dispatcher_thread
+    _dispatch_thread_id.store(std::this_thread::get_id(), std::memory_order_release);
     DEBUG("start event dispacher");
+    if (_cpu >= 0) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(_cpu, &cpu_set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (ret != 0) {
+            WARNING("event dispatcher bind to cpu %d failed, ret: %d", _cpu, ret);
+        }
+    }
     const uint32_t EXPECTED_EVENTS = (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP);
-    size_t event_size = WRPC_EVENT_DISPATCHER_EVENT_SIZE;
-    epoll_event e[event_size];
+    const int event_size = _event_size;
+    std::vector<epoll_event> events(event_size);
+    epoll_event* e = events.data();
     while (!_stop.load()) {
-#ifdef WRPC_ADDITIONAL_EPOLL
-        // Performance downgrades in examples.
-        int n = epoll_wait(_epoll_fd, e, event_size, 0);
-        if (n == 0) {
-            n = epoll_wait(_epoll_fd, e, event_size, -1);
-        }
-#else
-        const int n = epoll_wait(_epoll_fd, e, event_size, -1);
-#endif
+        const int n = wait_events(e, event_size);
         if (_stop.load()) {
             // epoll_ctl/epoll_wait should have some sort of memory fencing
             // guaranteeing that we(after epoll_wait) see _stop set before
@@ -155,67 +307,137 @@ void EventDispatcher::thread_run_wrapper() {
             break;
         }
         for (int i = 0; i < n; ++i) {
-            if (e[i].events & EXPECTED_EVENTS) {
-                notify((const ListenerData *) (&e[i].data.u64), e[i].events);
+            if (e[i].data.u64 == WAKEUP_EVENT_ID) {
+                run_posted_tasks();
+            } else if (e[i].events & EXPECTED_EVENTS) {
+                notify(e[i].data.u64, e[i].events);
                 DEBUG("notify epoll event: %d %d %lu", i, e[i].events, e[i].data.u64);
             }
         }
+        run_expired_timers();
     }
     DEBUG("event dispacher stopped");
 }
 
-void EventDispatcher::notify(const ListenerData *data, uint32_t epoll_events) {
-    assert(data != nullptr);
-    ControllerPtr controller = ControllerAddresser::address(data->cid).lock();
+int EventDispatcher::wait_events(epoll_event* events, int event_size) {
+    int timeout = next_timer_timeout();
+    const uint32_t busy_poll_us = _busy_poll_us.load(std::memory_order_relaxed);
+    if (busy_poll_us > 0 && timeout != 0) {
+        // spin to save the wakeup latency of a blocked thread, never past the next timer
+        int64_t spin_us = busy_poll_us;
+        if (timeout > 0) {
+            spin_us = std::min<int64_t>(spin_us, timeout * 1000LL);
+        }
+        const int64_t start = monotonic_micro();
+        do {
+            int n = epoll_wait(_epoll_fd, events, event_size, 0);
+            if (n != 0) {
+                return n;
+            }
+        } while (monotonic_micro() - start < spin_us
+                && !_stop.load(std::memory_order_relaxed));
+        // timers may be due while spinning
+        timeout = next_timer_timeout();
+    }
+    return epoll_wait(_epoll_fd, events, event_size, timeout);
+}
+
+void EventDispatcher::notify(ConnectionId id, uint32_t epoll_events) {
+    int fd = -1;
+    ControllerId cid = ConnectionAddresser::dispatch(id, epoll_events, &fd);
+    if (cid == INVALID_CONTROLLER_ID) {
+        // connection closed or idle in pool
+        DEBUG("connection:%lu has no owner, ignore event", id);
+        return;
+    }
+    ControllerPtr controller = ControllerAddresser::address(cid).lock();
     if (!controller) {
-        WARNING("listener data %lu not found controller:%lu, ignore event", data->u64, data->cid);
+        WARNING("connection:%lu not found controller:%lu, ignore event", id, cid);
         return;
     }
 
     if (epoll_events & EPOLLIN) {
-        DEBUG("notify epoll in controller:%lu, fd:%d", data->cid, data->fd);
-        controller->on_epoll_in(data->fd);
+        DEBUG("notify epoll in controller:%lu, fd:%d", cid, fd);
+        controller->on_epoll_in(fd);
     } else {
-        DEBUG("notify epoll error controller:%lu, fd:%d", data->cid, data->fd);
-        controller->on_epoll_error(data->fd);
+        DEBUG("notify epoll error controller:%lu, fd:%d", cid, fd);
+        controller->on_epoll_error(fd);
     }
 }
 
-static EventDispatcher g_disps[WRPC_EVENT_DISPATCHER_NUMS];
+// never deleted, dispatchers may be used by other static objects during exit
+static std::vector<EventDispatcher*>* g_disps = nullptr;
 static std::once_flag g_init_disp_once;
+static std::atomic<uint32_t> g_next_disp_index(0);
 
 static void stop_event_dispatchers() {
-    size_t num = WRPC_EVENT_DISPATCHER_NUMS;
     if (nullptr != g_disps) {
-        for (size_t i = 0; i < num; ++i) {
-            g_disps[i].stop(false);
+        for (EventDispatcher* disp : *g_disps) {
+            disp->stop(false);
         }
-        for (size_t i = 0; i < num; ++i) {
-            g_disps[i].join();
+        for (EventDispatcher* disp : *g_disps) {
+            disp->join();
         }
     }
     return;
 }
 
-static void init_event_dispatchers() {
-    size_t num = WRPC_EVENT_DISPATCHER_NUMS;
+static void start_event_dispatchers(const EventDispatcherOptions& options) {
+    size_t num = options.dispatcher_num > 0 ? options.dispatcher_num : 1;
+    std::vector<EventDispatcher*>* disps = new std::vector<EventDispatcher*>(num);
     for (size_t i = 0; i < num; ++i) {
-        if (0 != g_disps[i].start()) {
+        (*disps)[i] = new EventDispatcher();
+        int cpu = options.cpu_affinity.empty() ?
+                -1 : options.cpu_affinity[i % options.cpu_affinity.size()];
+        (*disps)[i]->set_busy_poll_us(options.busy_poll_us);
+        if (0 != (*disps)[i]->start(options.event_size, cpu)) {
             FATAL("Start event dispatcher %lu failed.", i);
-            return;
         }
     }
+    g_disps = disps;
     atexit(stop_event_dispatchers);
 }
 
-EventDispatcher& get_event_dispatcher(int fd) {
-    std::call_once(g_init_disp_once, init_event_dispatchers);
-    size_t num = WRPC_EVENT_DISPATCHER_NUMS;
+static void init_default_event_dispatchers() {
+    start_event_dispatchers(EventDispatcherOptions());
+}
+
+int init_event_dispatchers(const EventDispatcherOptions& options) {
+    bool inited = false;
+    std::call_once(g_init_disp_once, [&options, &inited]() {
+        start_event_dispatchers(options);
+        inited = true;
+    });
+    if (!inited) {
+        WARNING("event dispatchers are started already, options ignored");
+        return NET_INVALID_ARGUMENT;
+    }
+    return NET_SUCC;
+}
+
+size_t event_dispatcher_num() {
+    std::call_once(g_init_disp_once, init_default_event_dispatchers);
+    return g_disps->size();
+}
+
+void set_event_dispatchers_busy_poll(uint32_t busy_poll_us) {
+    size_t num = event_dispatcher_num();
+    for (size_t i = 0; i < num; ++i) {
+        (*g_disps)[i]->set_busy_poll_us(busy_poll_us);
+    }
+}
+
+uint32_t next_event_dispatcher_index() {
+    size_t num = event_dispatcher_num();
     if (num == 1) {
-        return g_disps[0];
-    } else {
-        return g_disps[static_cast<size_t>(fd) % num];
+        return 0;
     }
+    return g_next_disp_index.fetch_add(1, std::memory_order_relaxed) % num;
+}
+
+EventDispatcher& get_event_dispatcher(uint32_t index) {
+    size_t num = event_dispatcher_num();
+    return *(*g_disps)[num == 1 ? 0 : index % num];
 }
  
 } // end namespace wrpc
@@ -10,25 +10,48 @@
 #define WRPC_NETWORK_EVENT_DISPATCHER_H_
  
 #include <atomic>
+#include <functional>
 #include <memory>
+#include <sys/epoll.h>
 #include <thread>
+#include <vector>
 
+#include "common/options.h"
 #include "network/network_common.h"
 #include "utils/common_define.h"
+#include "utils/mpsc_queue.h"
  
 namespace wrpc {
 
-#pragma pack(1)
-union ListenerData {
-    // epoll_eventṹŵ
-    uint64_t u64;
-    // dataʽĽ
-    struct {
-        ControllerId cid;
-        int16_t fd;
-    };
+typedef std::function<void ()> DispatcherTask;
+
+class EventDispatcher;
+
+// 分发器线程上的定时任务, cancel可在任意线程调用
+class DispatcherTimer {
+public:
+    DispatcherTimer(EventDispatcher* dispatcher, DispatcherTask&& task, int64_t deadline_us)
+        : _dispatcher(dispatcher), _task(std::move(task)), _deadline_us(deadline_us),
+          _expired(false) {}
+
+    // 返回true表示取消成功, 任务已执行或已取消时返回false
+    bool cancel();
+
+    int64_t deadline_us() const { return _deadline_us; }
+
+private:
+    DispatcherTimer(const DispatcherTimer&) = delete;
+    DispatcherTimer& operator = (const DispatcherTimer&) = delete;
+
+    friend class EventDispatcher;
+    EventDispatcher* _dispatcher;
+    DispatcherTask _task;
+    const int64_t _deadline_us;
+    // canceled or fired
+    std::atomic<bool> _expired;
 };
-#pragma pack()
+
+typedef std::shared_ptr<DispatcherTimer> DispatcherTimerPtr;
 
 class EventDispatcher {
 public:
@@ -38,7 +61,8 @@ public:
     EventDispatcher(const EventDispatcher&) = delete;
     EventDispatcher& operator = (const EventDispatcher&) = delete;
 
-    int start();
+    // cpu < 0 for not pinned
+    int start(uint32_t event_size = WRPC_EVENT_DISPATCHER_EVENT_SIZE, int cpu = -1);
 
     void stop(bool wait = true);
 
@@ -46,26 +70,79 @@ public:
 
     void join();
 
-    int add_listener(ControllerId cid, int fd);
+    // fd is listened edge triggered until removed or closed, events are dispatched to
+    // the current owner of the connection, see ConnectionAddresser
+    int add_listener(ConnectionId id, int fd);
 
     int remove_listener(int fd);
 
+    // 投递任务到分发器线程中执行, 可在任意线程调用, 按投递顺序执行
+    // 分发器未运行时返回-1, 停止时尚未执行的任务被丢弃
+    int post(DispatcherTask&& task);
+
+    bool in_dispatcher_thread() const;
+
+    // delay_ms后在分发器线程中执行task, 分发器未运行时返回nullptr
+    // task应尽快返回, 不能阻塞分发器
+    DispatcherTimerPtr add_timer(DispatcherTask&& task, int64_t delay_ms);
+
+    // 阻塞在epoll_wait前自旋轮询的时长, 0表示不自旋, 运行中可修改
+    void set_busy_poll_us(uint32_t busy_poll_us) {
+        _busy_poll_us.store(busy_poll_us, std::memory_order_relaxed);
+    }
+    uint32_t busy_poll_us() const {
+        return _busy_poll_us.load(std::memory_order_relaxed);
+    }
+
 private:
+    friend class DispatcherTimer;
     void thread_run_wrapper();
-    void notify(const ListenerData *data, uint32_t epoll_events);
+    void notify(ConnectionId id, uint32_t epoll_events);
+    void wakeup();
+    void run_posted_tasks();
+    void insert_timer(const DispatcherTimerPtr& timer);
+    int next_timer_timeout();
+    void run_expired_timers();
     void release_fd();
+    int wait_events(epoll_event* events, int event_size);
 
 private:
     int _epoll_fd;
+    uint32_t _event_size;
+    int _cpu;
+    std::atomic<uint32_t> _busy_poll_us;
     std::atomic<bool> _stop;
     std::atomic<bool> _is_running;
     std::unique_ptr<std::thread> _dispatch_thread;
+    // set by dispatcher thread itself, read by any thread
+    std::atomic<std::thread::id> _dispatch_thread_id;
+
+    // eventfd to wakeup EventDispatcher from `epoll_wait' to run posted tasks or quit
+    int _wakeup_fd;
+    // set by the first poster after last wakeup, later posters need not write eventfd
+    std::atomic<bool> _wakeup_pending;
+    MPSCQueue<DispatcherTask> _tasks;
 
-    // Pipe fds to wakeup EventDispatcher from `epoll_wait' in order to quit
-    int _wakeup_fds[2];
+    // min heap of deadline, only accessed by dispatcher thread
+    // canceled timers are dropped lazily, or compacted when they are the majority
+    std::vector<DispatcherTimerPtr> _timers;
+    std::atomic<size_t> _canceled_timers;
 };
 
-EventDispatcher& get_event_dispatcher(int fd);
+// start global event dispatchers with options, should be called before any rpc
+// dispatchers are started with default options on first use if not called
+// return NET_INVALID_ARGUMENT if started already
+int init_event_dispatchers(const EventDispatcherOptions& options);
+
+size_t event_dispatcher_num();
+
+// change busy poll budget of all dispatchers at runtime
+void set_event_dispatchers_busy_poll(uint32_t busy_poll_us);
+
+// round robin, each connection takes one on creation and sticks to it
+uint32_t next_event_dispatcher_index();
+
+EventDispatcher& get_event_dispatcher(uint32_t index);
  
 } // end namespace wrpc
  
@@ -0,0 +1,241 @@
+/**
+ * @file connection_read_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2026-10-18 22:03:47
+ * @brief blocking read and read_line of Connection over its read buffer, lines split across
+ *        recvs, bodies larger than the buffer, eof in the middle of a line and timeout
+ *
+ **/
+
+#include <netinet/in.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "wrpc/common/end_point.h"
+#include "wrpc/network/connection.h"
+#include "wrpc/utils/common_define.h"
+#include "wrpc/utils/common_flags.h"
+
+using namespace wrpc;
+
+static const int32_t kTimeoutMs = 1000;
+static const int32_t kShortTimeoutMs = 50;
+// larger than the read buffer of a connection, read directly into user buffer
+static const size_t kLargeBodySize = WRPC_CONNECTION_READ_BUFFER_SIZE * 4 + 123;
+
+// checked in release builds as well, report and fail the current case
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+static void sleep_ms(int64_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static int64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t ret = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+// peer writing in background, joined when a case returns early on failure
+class Writer {
+public:
+    template<typename Func>
+    explicit Writer(Func&& func) : _thread(std::forward<Func>(func)) {}
+    ~Writer() { join(); }
+
+    void join() {
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+    }
+
+private:
+    std::thread _thread;
+};
+
+// connection connected to a loopback listener, the accepted socket plays the peer
+class ConnectedPair {
+public:
+    ConnectedPair() : _peer_fd(-1) {}
+    ~ConnectedPair() { close_peer(); }
+
+    bool open() {
+        int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0) {
+            return false;
+        }
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        bool ok = bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) == 0
+                && listen(listen_fd, 1) == 0
+                && getsockname(listen_fd, (struct sockaddr*) &addr, &len) == 0;
+        if (ok) {
+            EndPoint end_point(string_to_ip("127.0.0.1"), ntohs(addr.sin_port));
+            _connection.reset(new Connection(end_point));
+            ok = _connection->connect(kTimeoutMs) == NET_SUCC;
+        }
+        if (ok) {
+            _peer_fd = accept(listen_fd, nullptr, nullptr);
+            ok = _peer_fd >= 0;
+        }
+        close(listen_fd);
+        return ok;
+    }
+
+    Connection* connection() { return _connection.get(); }
+    int peer_fd() const { return _peer_fd; }
+
+    void close_peer() {
+        if (_peer_fd >= 0) {
+            close(_peer_fd);
+            _peer_fd = -1;
+        }
+    }
+
+private:
+    ConnectionPtr _connection;
+    int _peer_fd;
+};
+
+static bool test_split_line() {
+    ConnectedPair pair;
+    CHECK(pair.open());
+    // a line arrives in pieces, a second line in the same recv as the end of the first
+    Writer writer([&pair] () {
+        send_all(pair.peer_fd(), "HELLO WO");
+        sleep_ms(20);
+        send_all(pair.peer_fd(), "RLD\r\nNEXT");
+        sleep_ms(20);
+        send_all(pair.peer_fd(), " LINE\nabcdefgh\n");
+    });
+    char buf[64];
+    ssize_t ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 13 && memcmp(buf, "HELLO WORLD\r\n", ret) == 0);
+    ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 10 && memcmp(buf, "NEXT LINE\n", ret) == 0);
+    // line longer than max_size is returned in parts
+    ret = pair.connection()->read_line(buf, 4, kTimeoutMs);
+    CHECK(ret == 4 && memcmp(buf, "abcd", ret) == 0);
+    ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 5 && memcmp(buf, "efgh\n", ret) == 0);
+    writer.join();
+    CHECK(pair.connection()->read_buffer().empty());
+    fprintf(stdout, "split line ok\n");
+    return true;
+}
+
+static bool test_large_body() {
+    ConnectedPair pair;
+    CHECK(pair.open());
+    std::string body(kLargeBodySize, '\0');
+    for (size_t i = 0; i < body.size(); ++i) {
+        body[i] = static_cast<char>('a' + i % 26);
+    }
+    // header and the head of body are buffered together, the rest bypasses the buffer
+    std::string message = "Content-Length: " + std::to_string(body.size()) + "\r\n" + body;
+    Writer writer([&pair, &message] () {
+        send_all(pair.peer_fd(), message.substr(0, message.size() / 3));
+        sleep_ms(20);
+        send_all(pair.peer_fd(), message.substr(message.size() / 3));
+    });
+    char line[64];
+    ssize_t ret = pair.connection()->read_line(line, sizeof(line), kTimeoutMs);
+    std::string header = "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    CHECK(ret == static_cast<ssize_t>(header.size()));
+    CHECK(memcmp(line, header.data(), ret) == 0);
+
+    std::string received(body.size(), '\0');
+    ret = pair.connection()->read(&received[0], received.size(), kTimeoutMs);
+    CHECK(ret == static_cast<ssize_t>(body.size()));
+    CHECK(received == body);
+    CHECK(pair.connection()->read_buffer().empty());
+    writer.join();
+    fprintf(stdout, "large body ok\n");
+    return true;
+}
+
+static bool test_eof_in_line() {
+    ConnectedPair pair;
+    CHECK(pair.open());
+    CHECK(send_all(pair.peer_fd(), "LINE\nPARTIAL"));
+    pair.close_peer();
+
+    char buf[64];
+    ssize_t ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 5 && memcmp(buf, "LINE\n", ret) == 0);
+    // eof ends the last line
+    ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 7 && memcmp(buf, "PARTIAL", ret) == 0);
+    ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 0);
+    ret = pair.connection()->read(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 0);
+    fprintf(stdout, "eof in line ok\n");
+    return true;
+}
+
+static bool test_timeout() {
+    ConnectedPair pair;
+    CHECK(pair.open());
+    char buf[64];
+    int64_t start = now_ms();
+    ssize_t ret = pair.connection()->read_line(buf, sizeof(buf), kShortTimeoutMs);
+    int64_t cost = now_ms() - start;
+    CHECK(ret == NET_TIMEOUT);
+    CHECK(cost >= kShortTimeoutMs - 5 && cost < kTimeoutMs);
+
+    start = now_ms();
+    ret = pair.connection()->read(buf, sizeof(buf), kShortTimeoutMs);
+    cost = now_ms() - start;
+    CHECK(ret == NET_TIMEOUT);
+    CHECK(cost >= kShortTimeoutMs - 5 && cost < kTimeoutMs);
+
+    // bypass path times out as well
+    std::string large(kLargeBodySize, '\0');
+    ret = pair.connection()->read(&large[0], large.size(), kShortTimeoutMs);
+    CHECK(ret == NET_TIMEOUT);
+
+    // still usable after timeout
+    CHECK(send_all(pair.peer_fd(), "LATE\n"));
+    ret = pair.connection()->read_line(buf, sizeof(buf), kTimeoutMs);
+    CHECK(ret == 5 && memcmp(buf, "LATE\n", ret) == 0);
+    fprintf(stdout, "timeout ok\n");
+    return true;
+}
+
+int main() {
+    bool ok = test_split_line();
+    ok = test_large_body() && ok;
+    ok = test_eof_in_line() && ok;
+    ok = test_timeout() && ok;
+    return ok ? 0 : 1;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
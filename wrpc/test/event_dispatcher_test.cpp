@@ -0,0 +1,262 @@
+/**
+ * @file event_dispatcher_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2026-10-18 21:14:05
+ * @brief EventDispatcher test, tasks posted by several threads run on the dispatcher thread
+ *        in posting order and always wake it up, timers fire in deadline order, canceled
+ *        timers never fire and are dropped lazily or by compaction
+ *
+ **/
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "wrpc/network/event_dispatcher.h"
+
+using namespace wrpc;
+
+static const size_t kProducerNum = 4;
+static const size_t kTasksPerProducer = 20000;
+static const size_t kWakeupRounds = 1000;
+// more timers than the compaction threshold of the dispatcher
+static const size_t kCompactTimers = 2000;
+static const size_t kCompactKept = 500;
+
+// checked in release builds as well, report and fail the current case
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+static void sleep_ms(int64_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// wait until done returns true, false on timeout
+template<typename Pred>
+static bool wait_until(Pred done, int64_t timeout_ms) {
+    for (int64_t i = 0; i < timeout_ms; ++i) {
+        if (done()) {
+            return true;
+        }
+        sleep_ms(1);
+    }
+    return done();
+}
+
+// a loop of the dispatcher runs, so that lazily dropped timers are checked
+static bool run_one_loop(EventDispatcher* dispatcher) {
+    std::atomic<bool> done(false);
+    CHECK(dispatcher->post([&done] () { done.store(true); }) == 0);
+    CHECK(wait_until([&done] () { return done.load(); }, 1000));
+    // timers are checked after posted tasks in the same loop, one more to be sure
+    done.store(false);
+    CHECK(dispatcher->post([&done] () { done.store(true); }) == 0);
+    CHECK(wait_until([&done] () { return done.load(); }, 1000));
+    return true;
+}
+
+static bool test_post_from_threads(EventDispatcher* dispatcher) {
+    // only touched by the dispatcher thread
+    std::vector<size_t> next_seq(kProducerNum, 0);
+    std::atomic<size_t> executed(0);
+    std::atomic<size_t> misplaced(0);
+    std::atomic<size_t> failed_posts(0);
+
+    std::vector<std::thread> producers;
+    for (size_t i = 0; i < kProducerNum; ++i) {
+        producers.emplace_back([&, i] () {
+            for (size_t seq = 0; seq < kTasksPerProducer; ++seq) {
+                int ret = dispatcher->post([&, i, seq] () {
+                    // tasks of one producer run in posting order
+                    if (!dispatcher->in_dispatcher_thread() || next_seq[i] != seq) {
+                        misplaced.fetch_add(1);
+                    }
+                    next_seq[i] = seq + 1;
+                    executed.fetch_add(1);
+                });
+                if (ret != 0) {
+                    failed_posts.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < kProducerNum; ++i) {
+        producers[i].join();
+    }
+    CHECK(failed_posts.load() == 0);
+    CHECK(wait_until([&executed] () {
+        return executed.load() == kProducerNum * kTasksPerProducer;
+    }, 5000));
+    CHECK(misplaced.load() == 0);
+    CHECK(!dispatcher->in_dispatcher_thread());
+    fprintf(stdout, "post from threads ok\n");
+    return true;
+}
+
+static bool test_post_wakeup(EventDispatcher* dispatcher) {
+    // no timers, the dispatcher blocks in epoll_wait until the eventfd is written
+    // a pending flag left set after draining would skip the write of the next post
+    for (size_t i = 0; i < kWakeupRounds; ++i) {
+        std::atomic<bool> done(false);
+        CHECK(dispatcher->post([&done] () { done.store(true); }) == 0);
+        CHECK(wait_until([&done] () { return done.load(); }, 1000));
+        if (i % 100 == 0) {
+            // let the dispatcher fall asleep
+            sleep_ms(5);
+        }
+    }
+
+    // posted by a task, runs after the running batch is drained
+    std::atomic<int> step(0);
+    CHECK(dispatcher->post([dispatcher, &step] () {
+        dispatcher->post([&step] () { step.store(2); });
+        step.store(1);
+    }) == 0);
+    CHECK(wait_until([&step] () { return step.load() == 2; }, 1000));
+    fprintf(stdout, "post wakeup ok\n");
+    return true;
+}
+
+static bool test_post_after_stop() {
+    EventDispatcher dispatcher;
+    CHECK(dispatcher.post([] () {}) == -1);
+    CHECK(dispatcher.start() == 0);
+    CHECK(wait_until([&dispatcher] () { return dispatcher.is_running(); }, 1000));
+    CHECK(dispatcher.post(nullptr) == -1);
+    dispatcher.stop();
+    CHECK(dispatcher.post([] () {}) == -1);
+    CHECK(!dispatcher.add_timer([] () {}, 0));
+    fprintf(stdout, "post after stop ok\n");
+    return true;
+}
+
+static bool test_expire_order(EventDispatcher* dispatcher) {
+    const int64_t delays[] = {60, 20, 100, 0, 40, 80};
+    const size_t count = sizeof(delays) / sizeof(delays[0]);
+    std::mutex mutex;
+    std::vector<int64_t> fired;
+    std::vector<DispatcherTimerPtr> timers;
+    for (size_t i = 0; i < count; ++i) {
+        int64_t delay = delays[i];
+        DispatcherTimerPtr timer = dispatcher->add_timer([&mutex, &fired, delay, dispatcher] () {
+            std::lock_guard<std::mutex> lock(mutex);
+            fired.push_back(dispatcher->in_dispatcher_thread() ? delay : -1);
+        }, delay);
+        CHECK(timer);
+        timers.push_back(timer);
+    }
+
+    CHECK(wait_until([&mutex, &fired, count] () {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fired.size() == count;
+    }, 1000));
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 1; i < fired.size(); ++i) {
+        CHECK(fired[i - 1] >= 0);
+        CHECK(fired[i - 1] < fired[i]);
+    }
+    // fired already
+    for (size_t i = 0; i < timers.size(); ++i) {
+        CHECK(!timers[i]->cancel());
+    }
+    fprintf(stdout, "expire order ok\n");
+    return true;
+}
+
+static bool test_lazy_cancel(EventDispatcher* dispatcher) {
+    std::atomic<int> fired(0);
+    std::shared_ptr<int> token = std::make_shared<int>(0);
+    DispatcherTimerPtr canceled = dispatcher->add_timer([&fired, token] () {
+        fired.fetch_add(1);
+    }, 20);
+    DispatcherTimerPtr kept = dispatcher->add_timer([&fired] () {
+        fired.fetch_add(10);
+    }, 40);
+    CHECK(canceled && kept);
+    CHECK(canceled->cancel());
+    CHECK(!canceled->cancel());
+    canceled.reset();
+
+    CHECK(wait_until([&fired] () { return fired.load() != 0; }, 1000));
+    CHECK(fired.load() == 10);
+    // canceled timer is dropped from the heap without firing, the task is released
+    CHECK(wait_until([&token] () { return token.use_count() == 1; }, 1000));
+
+    // canceled timer on top is dropped before the dispatcher waits
+    DispatcherTimerPtr far = dispatcher->add_timer([&fired, token] () {
+        fired.fetch_add(100);
+    }, 60 * 1000);
+    CHECK(far);
+    CHECK(run_one_loop(dispatcher));
+    CHECK(token.use_count() == 2);
+    CHECK(far->cancel());
+    far.reset();
+    CHECK(run_one_loop(dispatcher));
+    CHECK(token.use_count() == 1);
+    CHECK(fired.load() == 10);
+    fprintf(stdout, "lazy cancel ok\n");
+    return true;
+}
+
+static bool test_compact(EventDispatcher* dispatcher) {
+    std::atomic<int> fired(0);
+    std::shared_ptr<int> token = std::make_shared<int>(0);
+    std::vector<DispatcherTimerPtr> kept;
+    std::vector<DispatcherTimerPtr> canceled;
+    // kept timers expire first, canceled ones are never on top and only compaction drops them
+    for (size_t i = 0; i < kCompactTimers; ++i) {
+        bool keep = i < kCompactKept;
+        DispatcherTimerPtr timer = dispatcher->add_timer([&fired, token] () {
+            fired.fetch_add(1);
+        }, keep ? 30 * 1000 : 60 * 1000);
+        CHECK(timer);
+        (keep ? kept : canceled).push_back(timer);
+    }
+    CHECK(run_one_loop(dispatcher));
+    CHECK(token.use_count() == static_cast<long>(kCompactTimers + 1));
+
+    for (size_t i = 0; i < canceled.size(); ++i) {
+        CHECK(canceled[i]->cancel());
+    }
+    canceled.clear();
+    // canceled timers are the majority of a large heap, compacted in the next loop
+    CHECK(run_one_loop(dispatcher));
+    CHECK(token.use_count() == static_cast<long>(kCompactKept + 1));
+
+    // below the threshold, canceled timers wait to be dropped lazily
+    for (size_t i = 0; i < kCompactKept; ++i) {
+        CHECK(kept[i]->cancel());
+    }
+    kept.clear();
+    CHECK(run_one_loop(dispatcher));
+    CHECK(fired.load() == 0);
+    fprintf(stdout, "compact ok\n");
+    return true;
+}
+
+int main() {
+    EventDispatcher dispatcher;
+    if (dispatcher.start() != 0) {
+        fprintf(stderr, "start event dispatcher failed\n");
+        return 1;
+    }
+    bool ok = test_post_from_threads(&dispatcher);
+    ok = test_post_wakeup(&dispatcher) && ok;
+    ok = test_expire_order(&dispatcher) && ok;
+    ok = test_lazy_cancel(&dispatcher) && ok;
+    ok = test_compact(&dispatcher) && ok;
+    dispatcher.stop();
+    ok = test_post_after_stop() && ok;
+    return ok ? 0 : 1;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
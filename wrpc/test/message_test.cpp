@@ -0,0 +1,204 @@
+/**
+ * @file message_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2026-10-18 15:20:36
+ * @brief incremental response parsing test, consume on every split of a reply
+ *        must give the same result as read_from on the whole reply
+ *
+ **/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "wrpc/message/http_message.h"
+#include "wrpc/message/redis_message.h"
+#include "wrpc/utils/common_define.h"
+
+using namespace wrpc;
+
+static const int32_t kTimeoutMs = 1000;
+
+// checked in release builds as well, report and fail the current reply
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d check failed: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+static const char* kHttpReplies[] = {
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 11\r\n"
+    "\r\n"
+    "hello world",
+
+    "HTTP/1.1 404 NotFound\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n",
+
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "5;name=value\r\n"
+    "hello\r\n"
+    "6\r\n"
+    " world\r\n"
+    "0\r\n"
+    "\r\n",
+};
+
+static const char* kRedisReplies[] = {
+    "+OK\r\n",
+    "+\r\n",
+    "-ERR unknown command\r\n",
+    ":1024\r\n",
+    "$5\r\nhello\r\n",
+    "$-1\r\n",
+    "*4\r\n$3\r\nfoo\r\n$-1\r\n:42\r\n$6\r\nbar\rxx\r\n",
+    "*2\r\n+QUEUED\r\n-WRONGTYPE bad type\r\n",
+    "*3\r\n+\r\n:0\r\n$1\r\nx\r\n",
+};
+
+// in-memory readable over a complete reply
+class StringReadable : public Readable {
+public:
+    explicit StringReadable(const std::string& data) : _data(data), _pos(0) {}
+
+    virtual ssize_t read(char* buf, size_t size, int32_t /*timeout_ms*/) {
+        size_t len = std::min(size, _data.size() - _pos);
+        memcpy(buf, _data.data() + _pos, len);
+        _pos += len;
+        return len;
+    }
+
+    bool eof() const { return _pos == _data.size(); }
+
+private:
+    std::string _data;
+    size_t _pos;
+};
+
+// feed reply to response piece by piece as a connection does, bytes not consumed
+// are passed again together with the next piece
+template<typename Response>
+static bool consume_pieces(const std::string& reply, const std::vector<size_t>& splits,
+        Response* response) {
+    response->reset();
+    std::string pending;
+    size_t begin = 0;
+    for (size_t i = 0; i <= splits.size(); ++i) {
+        size_t end = i < splits.size() ? splits[i] : reply.size();
+        pending.append(reply, begin, end - begin);
+        begin = end;
+
+        size_t consumed = 0;
+        ParseResult result = response->consume(pending.data(), pending.size(), &consumed);
+        CHECK(consumed <= pending.size());
+        pending.erase(0, consumed);
+        if (end < reply.size()) {
+            CHECK(result == PARSE_NEED_MORE);
+        } else {
+            // done exactly at the end of reply
+            CHECK(result == PARSE_DONE);
+            CHECK(pending.empty());
+        }
+    }
+    return true;
+}
+
+static bool check_http_equal(const HttpResponse& expect, const HttpResponse& actual) {
+    CHECK(expect.code() == actual.code());
+    CHECK(expect.reason() == actual.reason());
+    CHECK(expect.version() == actual.version());
+    CHECK(expect.headers() == actual.headers());
+    CHECK(expect.is_chunked() == actual.is_chunked());
+    CHECK(expect.body_len() == actual.body_len());
+    CHECK(memcmp(expect.body(), actual.body(), expect.body_len()) == 0);
+    CHECK(expect.chunks().size() == actual.chunks().size());
+    for (size_t i = 0; i < expect.chunks().size(); ++i) {
+        const ChunkData& expect_chunk = expect.chunks()[i];
+        const ChunkData& actual_chunk = actual.chunks()[i];
+        CHECK(expect_chunk.size() == actual_chunk.size());
+        CHECK(expect_chunk.extension() == actual_chunk.extension());
+        CHECK(memcmp(expect_chunk.data(), actual_chunk.data(), expect_chunk.size()) == 0);
+    }
+    return true;
+}
+
+static bool check_redis_equal(const RedisResponse& expect, const RedisResponse& actual) {
+    const RedisReponseList& expect_list = expect.response_list();
+    const RedisReponseList& actual_list = actual.response_list();
+    CHECK(expect_list.size() == actual_list.size());
+    for (size_t i = 0; i < expect_list.size(); ++i) {
+        const RedisReponseItem& expect_item = expect_list[i];
+        const RedisReponseItem& actual_item = actual_list[i];
+        CHECK(expect_item.type() == actual_item.type());
+        CHECK(expect_item.integer() == actual_item.integer());
+        CHECK(expect_item.message() == actual_item.message());
+        CHECK(expect_item.detail() == actual_item.detail());
+        CHECK(expect_item.data_len() == actual_item.data_len());
+        // items without data have no buffer
+        CHECK(expect_item.data_len() == 0
+                || memcmp(expect_item.data(), actual_item.data(), expect_item.data_len()) == 0);
+    }
+    return true;
+}
+
+template<typename Response>
+static bool test_reply(const std::string& reply,
+        bool (*check_equal)(const Response&, const Response&)) {
+    Response expect;
+    StringReadable readable(reply);
+    int ret = expect.read_from(&readable, kTimeoutMs);
+    CHECK(ret == NET_SUCC);
+    CHECK(readable.eof());
+
+    Response actual;
+    std::vector<size_t> splits;
+    // whole reply at once
+    CHECK(consume_pieces(reply, splits, &actual));
+    CHECK(check_equal(expect, actual));
+
+    // two pieces split at every position, response reused as a pooled connection does
+    for (size_t pos = 1; pos < reply.size(); ++pos) {
+        splits.assign(1, pos);
+        CHECK(consume_pieces(reply, splits, &actual));
+        CHECK(check_equal(expect, actual));
+    }
+
+    // byte by byte
+    splits.clear();
+    for (size_t pos = 1; pos < reply.size(); ++pos) {
+        splits.push_back(pos);
+    }
+    CHECK(consume_pieces(reply, splits, &actual));
+    CHECK(check_equal(expect, actual));
+    return true;
+}
+
+int main() {
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(kHttpReplies) / sizeof(kHttpReplies[0]); ++i) {
+        if (!test_reply<HttpResponse>(kHttpReplies[i], &check_http_equal)) {
+            fprintf(stderr, "http reply %lu failed\n", i);
+            ++failed;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(kRedisReplies) / sizeof(kRedisReplies[0]); ++i) {
+        if (!test_reply<RedisResponse>(kRedisReplies[i], &check_redis_equal)) {
+            fprintf(stderr, "redis reply %lu failed\n", i);
+            ++failed;
+        }
+    }
+    fprintf(stdout, "%d replies failed\n", failed);
+    return failed == 0 ? 0 : 1;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,146 @@
+/**
+ * @file peer_close_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2026-10-18 20:06:31
+ * @brief pooled connection closed by peer right after the response must not be reused,
+ *        the close arrives in the same event as the response
+ *
+ **/
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "wrpc/message/http_message.h"
+#include "wrpc/network/channel.h"
+#include "wrpc/network/controller.h"
+
+using namespace wrpc;
+
+static const port_t kPort = 12348;
+static const int kRpcCount = 100;
+
+// answers one request per connection, then closes it like a server ignoring keep-alive
+class CloseAfterResponseServer {
+public:
+    CloseAfterResponseServer() : _listen_fd(-1), _stop(false) {}
+    ~CloseAfterResponseServer() { stop(); }
+
+    bool start() {
+        _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (_listen_fd < 0) {
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        // accept timeout, to check stop
+        struct timeval timeout = {0, 100000};
+        setsockopt(_listen_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(kPort);
+        if (bind(_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+                || listen(_listen_fd, 16) != 0) {
+            return false;
+        }
+        _thread = std::thread(&CloseAfterResponseServer::run, this);
+        return true;
+    }
+
+    void stop() {
+        _stop.store(true);
+        if (_thread.joinable()) {
+            _thread.join();
+        }
+        if (_listen_fd >= 0) {
+            close(_listen_fd);
+            _listen_fd = -1;
+        }
+    }
+
+private:
+    void run() {
+        while (!_stop.load()) {
+            int fd = accept(_listen_fd, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            // read the whole request, closing with unread data would reset the connection
+            std::string request;
+            char buf[4096];
+            while (request.find("\r\n\r\n") == std::string::npos) {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if (n <= 0) {
+                    break;
+                }
+                request.append(buf, n);
+            }
+            // corked, the response and FIN leave in one segment and show up in one event
+            int cork = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+            const char* response = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+            ssize_t ret = send(fd, response, strlen(response), MSG_NOSIGNAL);
+            (void)ret;
+            close(fd);
+        }
+    }
+
+    int _listen_fd;
+    std::atomic<bool> _stop;
+    std::thread _thread;
+};
+
+static int run_rpcs(bool run_in_dispatcher) {
+    ChannelOptions options;
+    options.protocol = "http_get";
+    options.connection_type = POOLED;
+    options.total_timeout_ms = 1000;
+    options.connect_timeout_ms = 500;
+    // a reused dead connection shows up as a failure instead of being retried
+    options.max_retry_num = 0;
+    options.run_in_dispatcher = run_in_dispatcher;
+    ChannelPtr channel = Channel::make_channel();
+    int ret = channel->init("list://127.0.0.1:" + std::to_string(kPort), options);
+    if (ret != NET_SUCC) {
+        fprintf(stderr, "init channel failed: %d\n", ret);
+        return kRpcCount;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < kRpcCount; ++i) {
+        ControllerPtr controller = channel->create_controller();
+        HttpRequest* request = (HttpRequest*) (controller->get_request());
+        request->set_host("127.0.0.1");
+        request->set_uri("/peer_close");
+        controller->submit();
+        ret = controller->join();
+        if (ret != NET_SUCC) {
+            fprintf(stderr, "rpc %d failed: %d\n", i, ret);
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+int main() {
+    CloseAfterResponseServer server;
+    if (!server.start()) {
+        fprintf(stderr, "start server failed\n");
+        return 1;
+    }
+    int failed = run_rpcs(false);
+    failed += run_rpcs(true);
+    server.stop();
+    fprintf(stdout, "%d of %d rpcs failed\n", failed, kRpcCount * 2);
+    return failed == 0 ? 0 : 1;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,212 @@
+/**
+ * @file slot_map_test.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2026-10-18 16:05:12
+ * @brief VersionedSlotMap test, stale ids after erase and slot reuse are rejected,
+ *        erase waits for in-flight visits
+ *
+ **/
+
+#include <assert.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "wrpc/utils/slot_map.h"
+
+using namespace wrpc;
+
+static const uint32_t kMagic = 0x5a5a5a5a;
+static const size_t kThreadNum = 8;
+// entries owned by each thread, a thread only inserts and erases its own entries
+static const size_t kEntriesPerThread = 16;
+static const size_t kRounds = 200000;
+static const size_t kStaleIdsKept = 64;
+
+struct Payload {
+    explicit Payload(size_t owner) : magic(kMagic), owner(owner) {}
+    uint32_t magic;
+    size_t owner;
+};
+
+// small blocks so that the stress test allocates several of them
+typedef VersionedSlotMap<Payload*, 4, 64> PayloadMap;
+typedef PayloadMap::Id Id;
+
+static uint32_t slot_index(Id id) {
+    return static_cast<uint32_t>(id);
+}
+
+static void test_stale_id() {
+    PayloadMap map;
+    Payload first(0);
+    Payload second(1);
+    Id id = map.insert(&first);
+    assert(id != PayloadMap::INVALID_ID);
+
+    Payload* value = nullptr;
+    bool found = map.visit(id, [&value](Payload*& p) { value = p; });
+    assert(found && value == &first);
+    bool erased = map.erase(id);
+    assert(erased);
+
+    // stale id before the slot is reused
+    found = map.visit(id, [](Payload*&) { assert(false); });
+    assert(!found);
+    erased = map.erase(id);
+    assert(!erased);
+
+    // the slot is reused with a new version, the stale id never matches it
+    Id new_id = map.insert(&second);
+    assert(slot_index(new_id) == slot_index(id));
+    assert(new_id != id);
+    found = map.visit(id, [](Payload*&) { assert(false); });
+    assert(!found);
+    erased = map.erase(id);
+    assert(!erased);
+    found = map.visit(new_id, [&value](Payload*& p) { value = p; });
+    assert(found && value == &second);
+    erased = map.erase(new_id);
+    assert(erased);
+
+    // never valid
+    found = map.visit(PayloadMap::INVALID_ID, [](Payload*&) { assert(false); });
+    assert(!found);
+    (void)found;
+    (void)erased;
+    fprintf(stdout, "stale id ok\n");
+}
+
+static void test_erase_waits_for_visit() {
+    PayloadMap map;
+    Payload payload(0);
+    Id id = map.insert(&payload);
+    std::atomic<bool> in_visit(false);
+    std::atomic<bool> visit_done(false);
+
+    std::thread visitor([&]() {
+        bool found = map.visit(id, [&](Payload*& p) {
+            in_visit.store(true);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            assert(p == &payload);
+            (void)p;
+            visit_done.store(true);
+        });
+        assert(found);
+        (void)found;
+    });
+
+    while (!in_visit.load()) {
+        std::this_thread::yield();
+    }
+    bool erased = map.erase(id);
+    assert(erased);
+    // erase returns only after the visit that saw the old version finished
+    assert(visit_done.load());
+    visitor.join();
+    (void)erased;
+    fprintf(stdout, "erase waits for visit ok\n");
+}
+
+std::atomic<Id> g_ids[kThreadNum * kEntriesPerThread];
+std::atomic<uint32_t> g_max_index(0);
+
+static void stress_thread_func(PayloadMap* map, size_t index) {
+    std::minstd_rand rand(index + 1);
+    std::vector<Id> stale_ids;
+    for (size_t i = 0; i < kRounds; ++i) {
+        if (rand() % 4 != 0) {
+            // visit any entry, it may be erased meanwhile
+            Id id = g_ids[rand() % (kThreadNum * kEntriesPerThread)].load();
+            map->visit(id, [](Payload*& p) {
+                uint32_t magic = p->magic;
+                std::this_thread::yield();
+                // payload is poisoned and freed after erase, never during visit
+                assert(magic == kMagic && p->magic == kMagic);
+                (void)magic;
+            });
+            continue;
+        }
+
+        std::atomic<Id>& entry = g_ids[index * kEntriesPerThread + rand() % kEntriesPerThread];
+        Id id = entry.load();
+        if (id == PayloadMap::INVALID_ID) {
+            Payload* payload = new Payload(index);
+            id = map->insert(payload);
+            assert(id != PayloadMap::INVALID_ID);
+            uint32_t max_index = g_max_index.load();
+            while (slot_index(id) > max_index
+                    && !g_max_index.compare_exchange_weak(max_index, slot_index(id))) {}
+            entry.store(id);
+            continue;
+        }
+
+        entry.store(PayloadMap::INVALID_ID);
+        Payload* payload = nullptr;
+        bool found = map->visit(id, [&payload](Payload*& p) { payload = p; });
+        assert(found && payload->owner == index);
+        bool erased = map->erase(id);
+        assert(erased);
+        payload->magic = 0;
+        delete payload;
+
+        stale_ids.push_back(id);
+        if (stale_ids.size() > kStaleIdsKept) {
+            stale_ids.erase(stale_ids.begin());
+        }
+        // slots of stale ids are reused by all threads meanwhile
+        for (Id stale_id : stale_ids) {
+            found = map->visit(stale_id, [](Payload*&) { assert(false); });
+            assert(!found);
+            erased = map->erase(stale_id);
+            assert(!erased);
+        }
+        (void)found;
+        (void)erased;
+    }
+}
+
+static void test_stress() {
+    PayloadMap map;
+    for (size_t i = 0; i < kThreadNum * kEntriesPerThread; ++i) {
+        g_ids[i].store(PayloadMap::INVALID_ID);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < kThreadNum; ++i) {
+        threads.emplace_back(stress_thread_func, &map, i);
+    }
+    for (size_t i = 0; i < kThreadNum; ++i) {
+        threads[i].join();
+    }
+
+    for (size_t i = 0; i < kThreadNum * kEntriesPerThread; ++i) {
+        Id id = g_ids[i].load();
+        if (id == PayloadMap::INVALID_ID) {
+            continue;
+        }
+        Payload* payload = nullptr;
+        bool found = map.visit(id, [&payload](Payload*& p) { payload = p; });
+        assert(found);
+        bool erased = map.erase(id);
+        assert(erased);
+        delete payload;
+        (void)found;
+        (void)erased;
+    }
+    // erased slots are reused, at most one slot per entry is in use at a time
+    assert(g_max_index.load() < kThreadNum * kEntriesPerThread);
+    fprintf(stdout, "stress ok, max slot index %u\n", g_max_index.load());
+}
+
+int main(int argc, char** argv) {
+    test_stale_id();
+    test_erase_waits_for_visit();
+    test_stress();
+    return 0;
+}
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
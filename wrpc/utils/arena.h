@@ -0,0 +1,171 @@
+/**
+ * @file arena.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-16 11:08:26
+ * @brief 顺序分配的内存arena, 内存块来自slab, 析构时一次性释放
+ *        用于一次rpc生命周期内的小对象, 非线程安全
+ **/
+
+#ifndef WRPC_UTILS_ARENA_H_
+#define WRPC_UTILS_ARENA_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <new>
+
+#include "slab_allocator.h"
+#include "utils/common_flags.h"
+
+namespace wrpc {
+
+class Arena {
+public:
+    static const size_t DEFAULT_ALIGN = 16;
+
+    explicit Arena(size_t block_size = WRPC_CONTROLLER_ARENA_BLOCK_SIZE)
+        : _block_size(block_size), _blocks(nullptr), _cur(nullptr), _end(nullptr) {}
+
+    ~Arena() {
+        release();
+    }
+
+    void* allocate(size_t size, size_t align = DEFAULT_ALIGN) {
+        char* p = align_up(_cur, align);
+        if (_cur != nullptr && p + size <= _end) {
+            _cur = p + size;
+            return p;
+        }
+
+        size_t need = sizeof(Block) + size + align;
+        Block* block = new_block(std::max(need, _block_size));
+        if (block == nullptr) {
+            return nullptr;
+        }
+        if (need > _block_size && _blocks != nullptr) {
+            // large one gets a dedicated block, current block keeps serving small ones
+            block->next = _blocks->next;
+            _blocks->next = block;
+            return align_up(reinterpret_cast<char*>(block + 1), align);
+        }
+        block->next = _blocks;
+        _blocks = block;
+        _end = reinterpret_cast<char*>(block) + block->size;
+        p = align_up(reinterpret_cast<char*>(block + 1), align);
+        _cur = p + size;
+        return p;
+    }
+
+    // objects in arena should be destroyed before release
+    void release() {
+        while (_blocks != nullptr) {
+            Block* next = _blocks->next;
+            common::slab_deallocate(_blocks, _blocks->size);
+            _blocks = next;
+        }
+        _cur = nullptr;
+        _end = nullptr;
+    }
+
+private:
+    // disallow copy and move
+    Arena(const Arena&) = delete;
+    Arena& operator = (const Arena&) = delete;
+
+    // header of each block
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    static char* align_up(char* p, size_t align) {
+        uintptr_t value = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<char*>((value + align - 1) & ~(align - 1));
+    }
+
+    static Block* new_block(size_t min_size) {
+        size_t size = common::SlabAllocator::block_size_of(min_size);
+        Block* block = static_cast<Block*>(common::slab_allocate(size));
+        if (block != nullptr) {
+            block->next = nullptr;
+            block->size = size;
+        }
+        return block;
+    }
+
+private:
+    const size_t _block_size;
+    Block* _blocks;
+    char* _cur;
+    char* _end;
+};
+
+// only destruct, memory is released with arena
+template<typename T>
+struct ArenaDeleter {
+    void operator()(T* p) const {
+        if (p != nullptr) {
+            p->~T();
+        }
+    }
+};
+
+// stl allocator over an arena, deallocate does nothing
+// falls back to operator new if no arena given
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    template<typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator() : _arena(nullptr) {}
+    explicit ArenaAllocator(Arena* arena) : _arena(arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        void* p = _arena != nullptr ?
+                _arena->allocate(n * sizeof(T), alignof(T)) : ::operator new(n * sizeof(T));
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t) {
+        if (_arena == nullptr) {
+            ::operator delete(p);
+        }
+    }
+
+    Arena* arena() const {
+        return _arena;
+    }
+
+    template<typename U>
+    bool operator == (const ArenaAllocator<U>& other) const {
+        return _arena == other.arena();
+    }
+    template<typename U>
+    bool operator != (const ArenaAllocator<U>& other) const {
+        return _arena != other.arena();
+    }
+
+private:
+    Arena* _arena;
+};
+
+} // end namespace wrpc
+
+#endif // WRPC_UTILS_ARENA_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -16,7 +16,8 @@
 namespace wrpc {
 
 typedef uint16_t port_t;
-typedef uint32_t ControllerId;
+typedef uint64_t ControllerId;
+typedef uint64_t ConnectionId;
  
 // network return codes
 
@@ -42,8 +43,11 @@ typedef uint32_t ControllerId;
 #define NET_DISCONNECTED -1001
 #define NET_SUCC 0
 
+// not an error, response is partially received, wait for more data
+#define NET_RECV_PARTIAL 1
+
 inline bool need_retry(int error_code) {
-    return error_code >= NET_NEED_RETRY_MIN && error_code <= NET_NEED_RETRY_MAX;
+    return error_code <= NET_NEED_RETRY_MIN && error_code >= NET_NEED_RETRY_MAX;
 }
 
 // Ȼԭ¹죬ڴ棬ʡһڴͻյĿ
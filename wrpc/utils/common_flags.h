@@ -19,6 +19,10 @@
 #define WRPC_USE_CONTROLLER_INST_POOL_CAPACITY 0
 #endif
 
+#ifndef WRPC_CONTROLLER_ARENA_BLOCK_SIZE
+#define WRPC_CONTROLLER_ARENA_BLOCK_SIZE 4096 // 4KB
+#endif
+
 #ifndef WRPC_EVENT_DISPATCHER_NUMS
 #define WRPC_EVENT_DISPATCHER_NUMS 1
 #endif
@@ -27,6 +31,10 @@
 #define WRPC_EVENT_DISPATCHER_EVENT_SIZE 32
 #endif
 
+#ifndef WRPC_CONNECTION_READ_BUFFER_SIZE
+#define WRPC_CONNECTION_READ_BUFFER_SIZE (16 * 1024) // 16KB
+#endif
+
 #ifndef WRPC_BACKGROUND_THREAD_NUMS
 #define WRPC_BACKGROUND_THREAD_NUMS 1
 #endif
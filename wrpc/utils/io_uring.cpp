@@ -0,0 +1,418 @@
+/**
+ * @file io_uring.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-25 16:40:18
+ * @brief
+ *
+ **/
+
+#include "utils/io_uring.h"
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define WRPC_HAS_IO_URING 1
+#endif
+#endif
+
+#ifdef WRPC_HAS_IO_URING
+#include <atomic>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "utils/common_define.h"
+#include "utils/timer.h"
+#include "utils/write_log.h"
+
+namespace wrpc {
+
+#ifdef WRPC_HAS_IO_URING
+
+// raw syscalls, no dependency on liburing
+class IoUring {
+public:
+    IoUring() : _ring_fd(-1), _ring_ptr(MAP_FAILED), _ring_size(0),
+                _sqes(static_cast<io_uring_sqe*>(MAP_FAILED)), _sqes_size(0) {}
+
+    ~IoUring() {
+        if (_sqes != MAP_FAILED) {
+            munmap(_sqes, _sqes_size);
+        }
+        if (_ring_ptr != MAP_FAILED) {
+            munmap(_ring_ptr, _ring_size);
+        }
+        if (_ring_fd >= 0) {
+            close(_ring_fd);
+        }
+    }
+
+    int init(unsigned entries);
+
+    /**
+     * @brief 提交op, timeout_ms >= 0时链接一个超时, 等待完成
+     *
+     * @return int
+     *        op的完成结果, 出错时为负的errno, 超时为-ETIME
+     */
+    int execute(const io_uring_sqe& op, int32_t timeout_ms);
+
+private:
+    IoUring(const IoUring&) = delete;
+    IoUring& operator = (const IoUring&) = delete;
+
+    static const uint64_t OP_DATA = 1;
+    static const uint64_t TIMEOUT_DATA = 2;
+
+    io_uring_sqe* get_sqe() {
+        unsigned tail = _sq_tail_local;
+        unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (tail - head >= _sq_entries) {
+            return nullptr;
+        }
+        unsigned index = tail & _sq_mask;
+        _sq_array[index] = index;
+        ++_sq_tail_local;
+        io_uring_sqe* sqe = _sqes + index;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    int enter(unsigned to_submit, unsigned min_complete) {
+        return syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete,
+                IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+
+    int _ring_fd;
+    void* _ring_ptr;
+    size_t _ring_size;
+    io_uring_sqe* _sqes;
+    size_t _sqes_size;
+
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned _sq_tail_local;
+    unsigned _sq_mask;
+    unsigned _sq_entries;
+    unsigned* _sq_array;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned _cq_mask;
+    io_uring_cqe* _cqes;
+};
+
+int IoUring::init(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (_ring_fd < 0) {
+        return -errno;
+    }
+    // sq and cq rings share one mapping, supported since linux 5.4
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        return -ENOTSUP;
+    }
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _ring_size = sq_size > cq_size ? sq_size : cq_size;
+    _ring_ptr = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            _ring_fd, IORING_OFF_SQ_RING);
+    if (_ring_ptr == MAP_FAILED) {
+        return -errno;
+    }
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe*>(mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES));
+    if (_sqes == MAP_FAILED) {
+        return -errno;
+    }
+
+    char* ring = static_cast<char*>(_ring_ptr);
+    _sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+    _sq_mask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+    _sq_entries = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_entries);
+    _sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+    _sq_tail_local = *_sq_tail;
+    _cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+    _cq_mask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+    return 0;
+}
+
+int IoUring::execute(const io_uring_sqe& op, int32_t timeout_ms) {
+    io_uring_sqe* sqe = get_sqe();
+    if (sqe == nullptr) {
+        return -EBUSY;
+    }
+    *sqe = op;
+    sqe->user_data = OP_DATA;
+    unsigned count = 1;
+
+    __kernel_timespec ts;
+    if (timeout_ms >= 0) {
+        io_uring_sqe* timeout_sqe = get_sqe();
+        if (timeout_sqe == nullptr) {
+            return -EBUSY;
+        }
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+        sqe->flags |= IOSQE_IO_LINK;
+        timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+        timeout_sqe->fd = -1;
+        timeout_sqe->addr = reinterpret_cast<uint64_t>(&ts);
+        timeout_sqe->len = 1;
+        timeout_sqe->user_data = TIMEOUT_DATA;
+        ++count;
+    }
+    __atomic_store_n(_sq_tail, _sq_tail_local, __ATOMIC_RELEASE);
+
+    // submit and wait in one syscall, op and its timeout both complete
+    unsigned to_submit = count;
+    unsigned completed = 0;
+    int op_res = -ECANCELED;
+    int timeout_res = 0;
+    while (completed < count) {
+        int ret = enter(to_submit, count - completed);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // ring state unknown, should not happen with enough entries
+            return -errno;
+        }
+        to_submit -= static_cast<unsigned>(ret) < to_submit ? ret : to_submit;
+
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = _cqes[head & _cq_mask];
+            if (cqe.user_data == OP_DATA) {
+                op_res = cqe.res;
+            } else {
+                timeout_res = cqe.res;
+            }
+            ++completed;
+            ++head;
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    }
+    if (op_res == -ECANCELED && timeout_res == -ETIME) {
+        return -ETIME;
+    }
+    return op_res;
+}
+
+// -1: not tried, 0: unsupported, 1: supported
+static std::atomic<int> g_uring_supported(-1);
+
+static IoUring* thread_ring() {
+    static thread_local IoUring* ring = nullptr;
+    static thread_local bool inited = false;
+    if (inited) {
+        return ring;
+    }
+    inited = true;
+    if (g_uring_supported.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
+    }
+    // never deleted, thread_local objects with destructors are not free on all toolchains
+    IoUring* r = new IoUring();
+    int ret = r->init(8);
+    if (ret != 0) {
+        WARNING("io_uring setup failed: %d, fall back to poll", ret);
+        delete r;
+        if (ret == -ENOSYS || ret == -EPERM || ret == -ENOTSUP) {
+            g_uring_supported.store(0, std::memory_order_relaxed);
+        }
+        return nullptr;
+    }
+    g_uring_supported.store(1, std::memory_order_relaxed);
+    ring = r;
+    return ring;
+}
+
+bool uring_available() {
+    return thread_ring() != nullptr;
+}
+
+int uring_connect_with_timeout(int fd, const struct sockaddr* addr, int32_t timeout_ms) {
+    if (fd < 0 || addr == nullptr) {
+        return NET_INVALID_ARGUMENT;
+    }
+    IoUring* ring = thread_ring();
+    if (ring == nullptr) {
+        return NET_NOT_SUPPORTED;
+    }
+    io_uring_sqe op;
+    memset(&op, 0, sizeof(op));
+    op.opcode = IORING_OP_CONNECT;
+    op.fd = fd;
+    op.addr = reinterpret_cast<uint64_t>(addr);
+    op.off = sizeof(struct sockaddr);
+    int ret = ring->execute(op, timeout_ms);
+    if (ret == 0) {
+        return NET_SUCC;
+    } else if (ret == -ETIME) {
+        DEBUG("connect fd[%d] timeout", fd);
+        return NET_TIMEOUT;
+    } else {
+        WARNING("connect fd[%d] failed, errno: [%d:%s]", fd, -ret, strerror(-ret));
+        return NET_CONNECT_FAIL;
+    }
+}
+
+ssize_t uring_readn(int fd, char* buf, size_t size, int32_t timeout_ms) {
+    if (fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    if (nullptr == buf) {
+        return NET_INVALID_ARGUMENT;
+    }
+    IoUring* ring = thread_ring();
+    if (ring == nullptr) {
+        return NET_NOT_SUPPORTED;
+    }
+
+    MillisecondsCountdownTimer timer(timeout_ms);
+    MillisecondsCountdownTimer::rep_type remain = timeout_ms;
+    io_uring_sqe op;
+    size_t done = 0;
+    while (done < size) {
+        memset(&op, 0, sizeof(op));
+        op.opcode = IORING_OP_RECV;
+        op.fd = fd;
+        op.addr = reinterpret_cast<uint64_t>(buf + done);
+        op.len = size - done;
+        op.msg_flags = MSG_NOSIGNAL;
+        int ret = ring->execute(op, remain);
+        if (ret == 0) {
+            // eof
+            break;
+        } else if (ret == -ETIME) {
+            DEBUG("read fd[%d] timeout", fd);
+            return NET_TIMEOUT;
+        } else if (ret == -EINTR) {
+            // retry
+        } else if (ret < 0) {
+            WARNING("read fd[%d] fail, errno: [%d:%s]", fd, -ret, strerror(-ret));
+            return NET_RECV_FAIL;
+        } else {
+            done += ret;
+        }
+        if (done < size && timer.timeout(&remain)) {
+            DEBUG("read fd[%d] timeout", fd);
+            return NET_TIMEOUT;
+        }
+    }
+    return static_cast<ssize_t>(done);
+}
+
+ssize_t uring_recv(int fd, char* buf, size_t size, int32_t timeout_ms) {
+    if (fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    if (nullptr == buf || size == 0) {
+        return NET_INVALID_ARGUMENT;
+    }
+    IoUring* ring = thread_ring();
+    if (ring == nullptr) {
+        return NET_NOT_SUPPORTED;
+    }
+
+    io_uring_sqe op;
+    while (true) {
+        memset(&op, 0, sizeof(op));
+        op.opcode = IORING_OP_RECV;
+        op.fd = fd;
+        op.addr = reinterpret_cast<uint64_t>(buf);
+        op.len = size;
+        op.msg_flags = MSG_NOSIGNAL;
+        int ret = ring->execute(op, timeout_ms);
+        if (ret >= 0) {
+            return ret;
+        } else if (ret == -ETIME) {
+            DEBUG("read fd[%d] timeout", fd);
+            return NET_TIMEOUT;
+        } else if (ret != -EINTR) {
+            WARNING("read fd[%d] fail, errno: [%d:%s]", fd, -ret, strerror(-ret));
+            return NET_RECV_FAIL;
+        }
+    }
+}
+
+ssize_t uring_writen(int fd, const char* buf, size_t size, int32_t timeout_ms) {
+    if (fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    if (nullptr == buf || size == 0) {
+        return NET_INVALID_ARGUMENT;
+    }
+    IoUring* ring = thread_ring();
+    if (ring == nullptr) {
+        return NET_NOT_SUPPORTED;
+    }
+
+    MillisecondsCountdownTimer timer(timeout_ms);
+    MillisecondsCountdownTimer::rep_type remain = timeout_ms;
+    io_uring_sqe op;
+    size_t done = 0;
+    while (done < size) {
+        memset(&op, 0, sizeof(op));
+        op.opcode = IORING_OP_SEND;
+        op.fd = fd;
+        op.addr = reinterpret_cast<uint64_t>(buf + done);
+        op.len = size - done;
+        op.msg_flags = MSG_NOSIGNAL;
+        int ret = ring->execute(op, remain);
+        if (ret == -ETIME) {
+            DEBUG("write fd[%d] timeout", fd);
+            return NET_TIMEOUT;
+        } else if (ret == -EINTR) {
+            // retry
+        } else if (ret < 0) {
+            WARNING("write fd[%d] fail, errno: [%d:%s]", fd, -ret, strerror(-ret));
+            return NET_SEND_FAIL;
+        } else {
+            done += ret;
+        }
+        if (done < size && timer.timeout(&remain)) {
+            DEBUG("write fd[%d] timeout", fd);
+            return NET_TIMEOUT;
+        }
+    }
+    return static_cast<ssize_t>(done);
+}
+
+#else // WRPC_HAS_IO_URING
+
+bool uring_available() {
+    return false;
+}
+
+int uring_connect_with_timeout(int, const struct sockaddr*, int32_t) {
+    return NET_NOT_SUPPORTED;
+}
+
+ssize_t uring_readn(int, char*, size_t, int32_t) {
+    return NET_NOT_SUPPORTED;
+}
+
+ssize_t uring_recv(int, char*, size_t, int32_t) {
+    return NET_NOT_SUPPORTED;
+}
+
+ssize_t uring_writen(int, const char*, size_t, int32_t) {
+    return NET_NOT_SUPPORTED;
+}
+
+#endif // WRPC_HAS_IO_URING
+
+} // end namespace wrpc
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
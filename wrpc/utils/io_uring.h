@@ -0,0 +1,38 @@
+/**
+ * @file io_uring.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-25 16:40:12
+ * @brief 基于io_uring的阻塞式socket读写, 语义同net_utils中的对应函数
+ *        每个线程一个ring, 操作和超时一起提交, 一次io_uring_enter完成提交和等待
+ *        内核不支持io_uring时uring_available()返回false, 调用方应回退到poll实现
+ **/
+
+#ifndef WRPC_UTILS_IO_URING_H_
+#define WRPC_UTILS_IO_URING_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+namespace wrpc {
+
+// whether io_uring can be used by current thread, ring is created on first call
+bool uring_available();
+
+// see connect_with_timeout
+int uring_connect_with_timeout(int fd, const struct sockaddr* addr, int32_t timeout_ms);
+
+// see readn
+ssize_t uring_readn(int fd, char* buf, size_t size, int32_t timeout_ms);
+
+// receive once, return bytes received, 0 for eof, NET_TIMEOUT or NET_RECV_FAIL
+ssize_t uring_recv(int fd, char* buf, size_t size, int32_t timeout_ms);
+
+// see writen
+ssize_t uring_writen(int fd, const char* buf, size_t size, int32_t timeout_ms);
+
+} // end namespace wrpc
+
+#endif // WRPC_UTILS_IO_URING_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,75 @@
+/**
+ * @file mpsc_queue.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-24 11:20:08
+ * @brief 多生产者单消费者无锁队列, push可在任意线程调用, pop只能在唯一的消费者线程调用
+ **/
+
+#ifndef WRPC_UTILS_MPSC_QUEUE_H_
+#define WRPC_UTILS_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+namespace wrpc {
+
+// linked list with a stub node, push is one atomic exchange
+// a push in progress may be invisible to pop until it links the previous node
+template <typename T>
+class MPSCQueue {
+public:
+    MPSCQueue() {
+        Node* stub = new Node();
+        _head.store(stub, std::memory_order_relaxed);
+        _tail = stub;
+    }
+
+    ~MPSCQueue() {
+        T value;
+        while (pop(&value)) {
+        }
+        delete _tail;
+    }
+
+    void push(T&& value) {
+        Node* node = new Node(std::move(value));
+        Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // consumer only
+    bool pop(T* value) {
+        Node* tail = _tail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        *value = std::move(next->value);
+        // next becomes the new stub
+        _tail = next;
+        delete tail;
+        return true;
+    }
+
+private:
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator = (const MPSCQueue&) = delete;
+
+    struct Node {
+        Node() : next(nullptr) {}
+        explicit Node(T&& v) : next(nullptr), value(std::move(v)) {}
+        std::atomic<Node*> next;
+        T value;
+    };
+
+    // producers push to head
+    std::atomic<Node*> _head;
+    // consumer pops from tail
+    Node* _tail;
+};
+
+} // end namespace wrpc
+
+#endif // WRPC_UTILS_MPSC_QUEUE_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
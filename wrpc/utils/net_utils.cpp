@@ -344,6 +344,34 @@ size_t writen(int fd, const char* buf, size_t size, int32_t timeout_ms) {
     return static_cast<ssize_t>(size - left);
 }
  
+int wait_readable(int fd, int32_t timeout_ms) {
+    if (fd < 0) {
+        return NET_DISCONNECTED;
+    }
+
+    MillisecondsCountdownTimer timer(timeout_ms);
+    MillisecondsCountdownTimer::rep_type remain = timeout_ms;
+
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN | POLLERR | POLLHUP | POLLNVAL;
+    while (true) {
+        int ret = poll(&pfd, 1, remain);
+        if (ret > 0) {
+            return NET_SUCC;
+        } else if (ret == 0) {
+            DEBUG("wait fd[%d] readable timeout", fd);
+            return NET_TIMEOUT;
+        } else if (errno != EINTR) {
+            WARNING("wait fd[%d] readable poll fail: %d errno: [%d:%s]", fd, ret, errno, strerror(errno));
+            return NET_RECV_FAIL;
+        } else if (timer.timeout(&remain)) {
+            DEBUG("wait fd[%d] readable timeout", fd);
+            return NET_TIMEOUT;
+        }
+    }
+}
+ 
 } // end namespace wrpc
  
 /* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -144,6 +144,21 @@ ssize_t readline(int fd, char* buf, size_t max_size, int32_t timeout_ms);
  *            NET_SEND_FAIL: д
  */
 size_t writen(int fd, const char* buf, size_t size, int32_t timeout_ms);
+
+/**
+ * @brief ȴfdɶ, Զ˹رջҲΪɶ, ֮Ķȡؽ
+ *
+ * @param [in] fd : int
+ * @param [in] timeout_ms : int32_t
+ *        ʱ, λms, <0ʾ賬ʱ
+ *
+ * @return int
+ *        NET_SUCC: ɶ
+ *        NET_DISCONNECTED: fd < 0
+ *        NET_TIMEOUT: ʱ
+ *        NET_RECV_FAIL: poll
+ */
+int wait_readable(int fd, int32_t timeout_ms);
  
 } // end namespace wrpc
  
@@ -0,0 +1,89 @@
+/**
+ * @file read_buffer.cpp
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-20 10:32:21
+ * @brief
+ *
+ **/
+
+#include "utils/read_buffer.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "utils/common_define.h"
+#include "utils/write_log.h"
+
+namespace wrpc {
+
+char* ReadBuffer::prepare(size_t* writable) {
+    if (!_buf) {
+        _buf = common::SlabBuffer(_capacity);
+        if (!_buf) {
+            *writable = 0;
+            return nullptr;
+        }
+    }
+    if (_begin > 0) {
+        // move remaining data to the front
+        memmove(_buf.get(), _buf.get() + _begin, _end - _begin);
+        _end -= _begin;
+        _begin = 0;
+    }
+    *writable = _capacity - _end;
+    return _buf.get() + _end;
+}
+
+ssize_t ReadBuffer::fill_once(int fd, bool* eof) {
+    *eof = false;
+    if (fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    size_t writable = 0;
+    char* space = prepare(&writable);
+    if (space == nullptr) {
+        return NET_INTERNAL_ERROR;
+    }
+    while (writable > 0) {
+        ssize_t nread = recv(fd, space, writable, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (nread > 0) {
+            commit(nread);
+            return nread;
+        } else if (nread == 0) {
+            *eof = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            WARNING("read fd[%d] fail: %ld, errno: [%d:%s]", fd, nread, errno, strerror(errno));
+            return NET_RECV_FAIL;
+        }
+    }
+    return 0;
+}
+
+ssize_t ReadBuffer::fill(int fd, bool* eof) {
+    *eof = false;
+    if (fd < 0) {
+        return NET_DISCONNECTED;
+    }
+    ssize_t total = 0;
+    while (!full()) {
+        ssize_t nread = fill_once(fd, eof);
+        if (nread < 0) {
+            return nread;
+        } else if (nread == 0) {
+            // EAGAIN or eof
+            break;
+        }
+        total += nread;
+    }
+    return total;
+}
+
+} // end namespace wrpc
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
@@ -0,0 +1,102 @@
+/**
+ * @file read_buffer.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-20 10:32:17
+ * @brief 连接上的读缓冲, 数据到达时非阻塞地从socket读入, 再交给响应解析器
+ *        解析器未消费的数据留在缓冲中, 和之后读到的数据一起再次交给解析器
+ *        连接的阻塞式read/read_line也从缓冲中读取, 缓冲随连接保留, 跨请求复用
+ **/
+
+#ifndef WRPC_UTILS_READ_BUFFER_H_
+#define WRPC_UTILS_READ_BUFFER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "slab_allocator.h"
+#include "utils/common_flags.h"
+
+namespace wrpc {
+
+class ReadBuffer {
+public:
+    // memory is allocated on first fill
+    explicit ReadBuffer(size_t capacity = WRPC_CONNECTION_READ_BUFFER_SIZE)
+        : _capacity(capacity), _begin(0), _end(0) {}
+    ~ReadBuffer() {}
+
+    const char* data() const { return _buf.get() + _begin; }
+    size_t size() const { return _end - _begin; }
+    bool empty() const { return _begin == _end; }
+    bool full() const { return _begin == 0 && _end == _capacity; }
+    size_t capacity() const { return _capacity; }
+
+    // drop size bytes from the front
+    void consume(size_t size) {
+        _begin += size < this->size() ? size : this->size();
+        if (_begin == _end) {
+            _begin = 0;
+            _end = 0;
+        }
+    }
+
+    void clear() {
+        _begin = 0;
+        _end = 0;
+    }
+
+    // free space at the end for writing, buffered data is moved to the front
+    // return nullptr if allocating memory failed
+    char* prepare(size_t* writable);
+
+    // size bytes are written to the space returned by prepare
+    void commit(size_t size) {
+        _end += size < _capacity - _end ? size : _capacity - _end;
+    }
+
+    /**
+     * @brief 非阻塞地调用一次recv, 读入缓冲的剩余空间
+     *
+     * @param [in] fd : int
+     * @param [out] eof : bool*
+     *        对端是否已关闭连接
+     *
+     * @return ssize_t
+     *        >0: 本次读到的字节数
+     *        =0: 暂无数据可读, 对端已关闭或缓冲已满
+     *        <0: 读取出错, 同fill
+     */
+    ssize_t fill_once(int fd, bool* eof);
+
+    /**
+     * @brief 非阻塞地读取fd上所有可读数据, 直到EAGAIN, eof或缓冲满
+     *
+     * @param [in] fd : int
+     * @param [out] eof : bool*
+     *        对端是否已关闭连接
+     *
+     * @return ssize_t
+     *        >=0: 本次读到的字节数
+     *        <0: 读取出错
+     *            NET_DISCONNECTED: fd < 0
+     *            NET_INTERNAL_ERROR: 申请内存失败
+     *            NET_RECV_FAIL: 读取出错
+     */
+    ssize_t fill(int fd, bool* eof);
+
+private:
+    // disallow copy
+    ReadBuffer(const ReadBuffer&) = delete;
+    ReadBuffer& operator = (const ReadBuffer&) = delete;
+
+    const size_t _capacity;
+    size_t _begin;
+    size_t _end;
+    common::SlabBuffer _buf;
+};
+
+} // end namespace wrpc
+
+#endif // WRPC_UTILS_READ_BUFFER_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */
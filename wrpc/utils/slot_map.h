@@ -0,0 +1,201 @@
+/**
+ * @file slot_map.h
+ * @author wangcong(a1e2w3@126.com)
+ * @date 2018-04-23 14:05:36
+ * @brief 带版本号的无锁slot map, id由slot下标和版本号组成
+ *        查找只需一次边界检查和原子操作, 已删除元素的旧id因版本号不匹配而失效
+ **/
+
+#ifndef WRPC_UTILS_SLOT_MAP_H_
+#define WRPC_UTILS_SLOT_MAP_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+namespace wrpc {
+
+/**
+ * id layout: high 32 bits version, low 32 bits slot index
+ * version of a slot is odd while in use and even while free, so a valid id is never 0
+ *
+ * each slot keeps a 64 bits word: high 32 bits version, low 32 bits count of visitors.
+ * erase bumps the version and waits for visitors who saw the old one, so value is never
+ * reset while visited. slots are allocated in blocks which are never freed.
+ */
+template <typename T, uint32_t BLOCK_BITS = 12, uint32_t MAX_BLOCKS = 4096>
+class VersionedSlotMap {
+public:
+    typedef uint64_t Id;
+    static const Id INVALID_ID = 0;
+
+    VersionedSlotMap() : _slot_num(0), _free_head(0) {
+        for (uint32_t i = 0; i < MAX_BLOCKS; ++i) {
+            _blocks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~VersionedSlotMap() {
+        for (uint32_t i = 0; i < MAX_BLOCKS; ++i) {
+            delete[] _blocks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // return INVALID_ID when all slots are in use
+    Id insert(const T& value) {
+        uint32_t index = 0;
+        if (!pop_free(&index) && !new_slot(&index)) {
+            return INVALID_ID;
+        }
+        Slot* slot = get_slot(index);
+        slot->value = value;
+        // publish, version becomes odd
+        uint64_t word = slot->version_ref.fetch_add(VERSION_ONE, std::memory_order_release);
+        word += VERSION_ONE;
+        return (word & VERSION_MASK) | index;
+    }
+
+    // must not be called inside visit of the same id, or it waits forever
+    bool erase(Id id) {
+        Slot* slot = get_valid_slot(id);
+        if (slot == nullptr) {
+            return false;
+        }
+        uint64_t word = slot->version_ref.load(std::memory_order_relaxed);
+        do {
+            if ((word & VERSION_MASK) != (id & VERSION_MASK)) {
+                // already erased
+                return false;
+            }
+        } while (!slot->version_ref.compare_exchange_weak(word, word + VERSION_ONE,
+                    std::memory_order_acq_rel, std::memory_order_relaxed));
+
+        // wait for visitors who saw the old version, they hold the slot only for a moment
+        while ((slot->version_ref.load(std::memory_order_acquire) & REF_MASK) != 0) {
+            std::this_thread::yield();
+        }
+        slot->value = T();
+        push_free(static_cast<uint32_t>(id));
+        return true;
+    }
+
+    // call func(T&) if id is valid, the value can not be erased during func
+    template <typename Func>
+    bool visit(Id id, Func&& func) {
+        Slot* slot = get_valid_slot(id);
+        if (slot == nullptr) {
+            return false;
+        }
+        // fast path for stale id
+        if ((slot->version_ref.load(std::memory_order_acquire) & VERSION_MASK)
+                != (id & VERSION_MASK)) {
+            return false;
+        }
+        uint64_t word = slot->version_ref.fetch_add(1, std::memory_order_acquire);
+        bool valid = (word & VERSION_MASK) == (id & VERSION_MASK);
+        if (valid) {
+            func(slot->value);
+        }
+        slot->version_ref.fetch_sub(1, std::memory_order_release);
+        return valid;
+    }
+
+private:
+    VersionedSlotMap(const VersionedSlotMap&) = delete;
+    VersionedSlotMap& operator = (const VersionedSlotMap&) = delete;
+
+    static const uint32_t BLOCK_SIZE = 1u << BLOCK_BITS;
+    static const uint64_t VERSION_ONE = 1ull << 32;
+    static const uint64_t VERSION_MASK = 0xFFFFFFFF00000000ull;
+    static const uint64_t REF_MASK = 0x00000000FFFFFFFFull;
+
+    struct Slot {
+        Slot() : version_ref(0), next_free(0) {}
+        std::atomic<uint64_t> version_ref;
+        // index + 1 of next free slot, 0 for end of list
+        std::atomic<uint32_t> next_free;
+        T value;
+    };
+
+    Slot* get_slot(uint32_t index) const {
+        uint32_t block = index >> BLOCK_BITS;
+        if (block >= MAX_BLOCKS) {
+            return nullptr;
+        }
+        Slot* slots = _blocks[block].load(std::memory_order_acquire);
+        return slots == nullptr ? nullptr : slots + (index & (BLOCK_SIZE - 1));
+    }
+
+    Slot* get_valid_slot(Id id) const {
+        uint32_t version = static_cast<uint32_t>(id >> 32);
+        if ((version & 1) == 0) {
+            return nullptr;
+        }
+        return get_slot(static_cast<uint32_t>(id));
+    }
+
+    bool new_slot(uint32_t* index) {
+        uint32_t num = _slot_num.load(std::memory_order_relaxed);
+        do {
+            if (num >= BLOCK_SIZE * MAX_BLOCKS) {
+                return false;
+            }
+        } while (!_slot_num.compare_exchange_weak(num, num + 1, std::memory_order_relaxed));
+
+        uint32_t block = num >> BLOCK_BITS;
+        if (_blocks[block].load(std::memory_order_acquire) == nullptr) {
+            Slot* slots = new Slot[BLOCK_SIZE];
+            Slot* expected = nullptr;
+            if (!_blocks[block].compare_exchange_strong(expected, slots,
+                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+                // allocated by another thread
+                delete[] slots;
+            }
+        }
+        *index = num;
+        return true;
+    }
+
+    // free list is a stack of slot indexes, head tagged against ABA
+    // head layout: high 32 bits tag, low 32 bits index + 1
+    bool pop_free(uint32_t* index) {
+        uint64_t head = _free_head.load(std::memory_order_acquire);
+        while (true) {
+            uint32_t top = static_cast<uint32_t>(head);
+            if (top == 0) {
+                return false;
+            }
+            uint32_t next = get_slot(top - 1)->next_free.load(std::memory_order_relaxed);
+            uint64_t new_head = ((head & VERSION_MASK) + VERSION_ONE) | next;
+            if (_free_head.compare_exchange_weak(head, new_head,
+                        std::memory_order_acq_rel, std::memory_order_acquire)) {
+                *index = top - 1;
+                return true;
+            }
+        }
+    }
+
+    void push_free(uint32_t index) {
+        Slot* slot = get_slot(index);
+        uint64_t head = _free_head.load(std::memory_order_relaxed);
+        while (true) {
+            slot->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            uint64_t new_head = ((head & VERSION_MASK) + VERSION_ONE) | (index + 1);
+            if (_free_head.compare_exchange_weak(head, new_head,
+                        std::memory_order_release, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+private:
+    std::atomic<Slot*> _blocks[MAX_BLOCKS];
+    std::atomic<uint32_t> _slot_num;
+    std::atomic<uint64_t> _free_head;
+};
+
+} // end namespace wrpc
+
+#endif // WRPC_UTILS_SLOT_MAP_H_
+
+/* vim: set expandtab ts=4 sw=4 sts=4 tw=100: */